@@ -0,0 +1,46 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <stdint.h>
+
+/* Longest command line, longer lines are answered with an error */
+#define COMMAND_LINE_LENGTH 32
+
+/*
+
+Serial command interface, one command per line ( \r or \n ends it ):
+
+  help                       lists the commands
+  get [r1]                   sensor, temperature, setpoints and state of every room or one room,
+                             one room adds its control mode, gains and times
+  set r1 min 19.5            changes a setpoint, temperatures in degrees with one decimal
+  set r1 sensor 5            reads the temperature of the room from ADC5
+  set r1 mode pid            control mode of the room, onoff or pid ( see lib/control )
+  set r1 kp 50.0             pid gains kp, ki and kd, 0.0 to 127.9 permille per tenth of a degree
+  set r1 sample 10           seconds between two pid samples, 1 to 255
+  set r1 minon 60            seconds the heater stays on, minoff off, at least in onoff mode
+  add room [18.0 21.0]       adds a room, the setpoints default to 18.0 and 21.0
+  telemetry 1000 4           sample period in ms and samples per frame, 0 stops it,
+                             at most TELEMETRY_MAX_BATCH samples ( see lib/telemetry )
+  history r1 [s|m|q]         temperature history of a room, newest first: the last seconds,
+                             the minutes or the quarters of an hour ( see lib/history )
+  mem                        sram use in bytes: data, heap, stack now and at its deepest, the
+                             bytes never used and the deepest stack each interrupt saw
+  prof [reset]               cycles per interrupt handler and main loop pass: runs, then
+                             min avg max, then the min and max period, 2147483647 for
+                             134 s and up, then the percentage under 64, 128, ... 4096
+                             cycles and above ( see lib/profile )
+  dump                       rooms, tasks, cpu load, lost bytes and eeprom writes
+
+Every command answers with one or more lines, the last one is "ok" or "error: ...".
+
+*/
+
+/* Takes what came in over the USART and sends what fits of the answer, never waits */
+void pollCommands();
+
+/* Answers a command that did not come over the USART, like a report at boot.
+   Only while no other answer is being sent. */
+void runCommand(const char *command);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef UI_H
+#define UI_H
+
+#include <stdint.h>
+
+/* Data a screen can show, passed to uiNotify() when it changes */
+#define UI_DATA_TEMPERATURE 0x01
+#define UI_DATA_SETPOINTS 0x02
+#define UI_DATA_HISTORY 0x04
+
+/* Shows the first screen */
+void uiInit();
+
+/* Runs the transition of the current screen for a button event from buttons.h */
+void uiHandleButton(uint8_t buttonEvent);
+
+/* Renders the current screen again if it shows the data that changed */
+void uiNotify(uint8_t data);
+
+#endif
@@ -0,0 +1,36 @@
+/* Markers for the cycle benchmark ( pio run -e bench -t bench )
+
+   In the bench build BENCH_BEGIN and BENCH_END write the id of a measured
+   region to GPIOR1 and GPIOR2. tools/bench/simbench runs the firmware
+   under simavr, timestamps those writes with the simulator cycle counter
+   and reports min / max / average cycles per id. One marker costs a single
+   OUT instruction. In every other build the markers are empty.
+
+   tools/bench/bench.py reads the names of the ids from this file.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <hal.h>
+
+#define BENCH_SHIFT 1
+#define BENCH_WRITE_NUMBER 2
+#define BENCH_DISPLAY_REFRESH 3
+#define BENCH_TIMER0_ISR 4
+#define BENCH_SAMPLE_BUTTONS 5
+#define BENCH_READ_ADC 6
+#define BENCH_PRINT_STRING 7
+#define BENCH_CONTROL 8
+
+/* Written by the bench firmware when it is done, stops the simulation */
+#define BENCH_DONE 0xFF
+
+#ifdef BENCH
+#define BENCH_BEGIN(id) (GPIOR1 = (id))
+#define BENCH_END(id) (GPIOR2 = (id))
+#else
+#define BENCH_BEGIN(id)
+#define BENCH_END(id)
+#endif
+
+#endif
@@ -1,6 +1,6 @@
-#include <avr/io.h>
+#include <hal.h>
 
-#define NUMBER_OF_BUTTONS 3
+#include "buttons.h"
 
 #define BUTTON_DDR DDRC
 #define BUTTON_PORT PORTC
@@ -10,6 +10,27 @@
 #define BUTTON2 PC2
 #define BUTTON3 PC3
 
+#define BUTTON_MASK ((1 << NUMBER_OF_BUTTONS) - 1)
+
+#define TICKS(ms) ((ms) / BUTTON_SAMPLE_MS)
+
+/* Debounced state, bit i is set while button i is pushed */
+static uint8_t buttonState = 0;
+
+/* Two bit vertical counter: bit i of both bytes together count the samples
+   in which button i differed from buttonState */
+static uint8_t counter0 = 0xFF;
+static uint8_t counter1 = 0xFF;
+
+/* Events that are not taken yet, one bit per button for every event type */
+static uint8_t pendingEvents[BUTTON_REPEAT_FAST + 1];
+
+/* Samples the button has been held, and when it repeats next */
+static uint8_t holdTicks[NUMBER_OF_BUTTONS];
+static uint8_t repeatTicks[NUMBER_OF_BUTTONS];
+static uint8_t repeatInterval[NUMBER_OF_BUTTONS];
+static uint8_t repeatCount[NUMBER_OF_BUTTONS];
+
 void enableAllButtons()
 {
     for (int i = 0; i < NUMBER_OF_BUTTONS; i++)
@@ -35,6 +56,9 @@ void disableButton(int number)
     BUTTON_PORT &= ~(0 << (PC1 + number));
 }
 
+// The pin change interrupt only wakes the cpu, sampleButtons() does the rest
+EMPTY_INTERRUPT(PCINT1_vect);
+
 // enables interrupts for all buttons
 void enableAllButtonInterrupts()
 {
@@ -65,4 +89,79 @@ int buttonPushed(int number)
 int buttonReleased(int number)
 {
     return !buttonPushed(number);
-}
\ No newline at end of file
+}
+
+void sampleButtons()
+{
+    uint8_t pushed = (~BUTTON_PIN >> BUTTON1) & BUTTON_MASK;
+
+    // Every button that differs from its debounced state counts up, the others
+    // are reset. A button whose counter wraps around after 4 samples toggles.
+    uint8_t changed = buttonState ^ pushed;
+    counter0 = ~(counter0 & changed);
+    counter1 = counter0 ^ (counter1 & changed);
+    changed &= counter0 & counter1;
+    buttonState ^= changed;
+
+    pendingEvents[BUTTON_PRESS] |= buttonState & changed;
+    pendingEvents[BUTTON_RELEASE] |= ~buttonState & changed;
+
+    for (uint8_t i = 0; i < NUMBER_OF_BUTTONS; i++)
+    {
+        uint8_t bit = 1 << i;
+
+        if (!(buttonState & bit))
+        {
+            holdTicks[i] = 0;
+            continue;
+        }
+
+        if (changed & bit)
+        {
+            repeatTicks[i] = TICKS(BUTTON_REPEAT_DELAY_MS);
+            repeatInterval[i] = TICKS(BUTTON_REPEAT_START_MS);
+            repeatCount[i] = 0;
+        }
+
+        if (holdTicks[i] < 0xFF) holdTicks[i]++;
+        if (holdTicks[i] == TICKS(BUTTON_LONG_PRESS_MS))
+            pendingEvents[BUTTON_LONG_PRESS] |= bit;
+
+        if (!(BUTTON_REPEAT_MASK & bit) || --repeatTicks[i])
+            continue;
+
+        // Repeat and shorten the interval a little for the next one
+        if (repeatCount[i] < BUTTON_REPEAT_FAST_AFTER)
+        {
+            repeatCount[i]++;
+            pendingEvents[BUTTON_REPEAT] |= bit;
+        }
+        else
+        {
+            pendingEvents[BUTTON_REPEAT_FAST] |= bit;
+        }
+
+        if (repeatInterval[i] > TICKS(BUTTON_REPEAT_MIN_MS))
+            repeatInterval[i]--;
+        repeatTicks[i] = repeatInterval[i];
+    }
+}
+
+uint8_t nextButtonEvent()
+{
+    for (uint8_t type = 0; type < sizeof(pendingEvents); type++)
+    {
+        uint8_t pending = pendingEvents[type];
+        if (!pending) continue;
+
+        for (uint8_t i = 0; i < NUMBER_OF_BUTTONS; i++)
+        {
+            if (pending & (1 << i))
+            {
+                pendingEvents[type] &= ~(1 << i);
+                return BUTTON_EVENT(type, i);
+            }
+        }
+    }
+    return BUTTON_NO_EVENT;
+}
@@ -1,13 +1,52 @@
 #ifndef BUTTON_H
 #define BUTTON_H
 
+#include <stdint.h>
+
+#define NUMBER_OF_BUTTONS 3
+
+/* Time between two calls of sampleButtons() */
+#ifndef BUTTON_SAMPLE_MS
+#define BUTTON_SAMPLE_MS 10
+#endif
+
+/* A button counts as pushed or released after 4 equal samples in a row */
+#define BUTTON_LONG_PRESS_MS 800
+#define BUTTON_REPEAT_DELAY_MS 500
+#define BUTTON_REPEAT_START_MS 250
+#define BUTTON_REPEAT_MIN_MS 50
+/* Every repeat comes a bit sooner, after this many they are BUTTON_REPEAT_FAST */
+#define BUTTON_REPEAT_FAST_AFTER 10
+
+/* Buttons that auto repeat while they are held: left and right */
+#define BUTTON_REPEAT_MASK 0b101
+
+/* Button events, an event is (type << 4) | button */
+#define BUTTON_PRESS 0
+#define BUTTON_RELEASE 1
+#define BUTTON_LONG_PRESS 2
+#define BUTTON_REPEAT 3
+#define BUTTON_REPEAT_FAST 4
+
+#define BUTTON_NO_EVENT 0xFF
+#define BUTTON_EVENT(type, button) (((type) << 4) | (button))
+#define BUTTON_EVENT_TYPE(event) ((event) >> 4)
+#define BUTTON_EVENT_BUTTON(event) ((event) & 0x0F)
+
 void enableAllButtons();
 void enableButton(int button);
 
+/* The interrupt wakes the cpu from sleep, nothing more */
 void enableButtonInterrupt(int button);
 void enableAllButtonInterrupts();
 
 int buttonPushed(int button);
 int buttonReleased(int button);
 
-#endif
\ No newline at end of file
+/* Debounces all buttons at once, call it every BUTTON_SAMPLE_MS from a timer */
+void sampleButtons();
+
+/* Returns the next event found by sampleButtons() or BUTTON_NO_EVENT */
+uint8_t nextButtonEvent();
+
+#endif
@@ -0,0 +1,209 @@
+#include <hal.h>
+#include <bench.h>
+
+#include "control.h"
+
+#define DUTY_MAX_Q8 ((int32_t)CONTROL_DUTY_MAX << 8)
+
+struct ControlLoop
+{
+    uint8_t mode;
+    uint8_t sampleTicks;
+    uint8_t ticks;
+    int16_t kp;
+    int16_t ki;
+    int16_t kd;
+    uint16_t minOnSeconds;
+    uint16_t minOffSeconds;
+    uint16_t secondsInState; /* since the heater last switched, stops counting at 0xFFFF */
+    int32_t integral;        /* Q8 permille */
+    temperature_t lastTemp;
+    uint16_t duty;
+};
+
+static struct ControlLoop loops[MAX_NUMBER_OF_ROOMS];
+
+void initControl()
+{
+    for (uint8_t room = 0; room < MAX_NUMBER_OF_ROOMS; room++)
+    {
+        struct ControlLoop *loop = &loops[room];
+
+        loop->mode = CONTROL_ONOFF;
+        loop->kp = CONTROL_DEFAULT_KP;
+        loop->ki = CONTROL_DEFAULT_KI;
+        loop->kd = CONTROL_DEFAULT_KD;
+        loop->sampleTicks = CONTROL_DEFAULT_SAMPLE_TICKS;
+        loop->minOnSeconds = CONTROL_DEFAULT_MIN_ON_S;
+        loop->minOffSeconds = CONTROL_DEFAULT_MIN_OFF_S;
+
+        // Free to switch right away after a reset
+        loop->secondsInState = 0xFFFF;
+        loop->ticks = 0;
+        loop->integral = 0;
+        loop->duty = 0;
+    }
+}
+
+void setControlMode(uint8_t room, uint8_t mode)
+{
+    if (room >= MAX_NUMBER_OF_ROOMS) return;
+
+    struct ControlLoop *loop = &loops[room];
+    if (loop->mode == mode) return;
+
+    // Start the new mode from scratch on the next tick
+    loop->mode = mode;
+    loop->integral = 0;
+    loop->ticks = 0;
+    loop->lastTemp = roomCurrentTemp[room];
+}
+
+uint8_t getControlMode(uint8_t room)
+{
+    return room < MAX_NUMBER_OF_ROOMS ? loops[room].mode : CONTROL_ONOFF;
+}
+
+void setControlGains(uint8_t room, int16_t kp, int16_t ki, int16_t kd)
+{
+    if (room >= MAX_NUMBER_OF_ROOMS) return;
+
+    loops[room].kp = kp;
+    loops[room].ki = ki;
+    loops[room].kd = kd;
+}
+
+void getControlGains(uint8_t room, int16_t *kp, int16_t *ki, int16_t *kd)
+{
+    if (room >= MAX_NUMBER_OF_ROOMS) return;
+
+    *kp = loops[room].kp;
+    *ki = loops[room].ki;
+    *kd = loops[room].kd;
+}
+
+void setControlTiming(uint8_t room, uint8_t sampleTicks, uint16_t minOnSeconds, uint16_t minOffSeconds)
+{
+    if (room >= MAX_NUMBER_OF_ROOMS) return;
+
+    loops[room].sampleTicks = sampleTicks ? sampleTicks : 1;
+    loops[room].minOnSeconds = minOnSeconds;
+    loops[room].minOffSeconds = minOffSeconds;
+}
+
+void getControlTiming(uint8_t room, uint8_t *sampleTicks, uint16_t *minOnSeconds, uint16_t *minOffSeconds)
+{
+    if (room >= MAX_NUMBER_OF_ROOMS) return;
+
+    *sampleTicks = loops[room].sampleTicks;
+    *minOnSeconds = loops[room].minOnSeconds;
+    *minOffSeconds = loops[room].minOffSeconds;
+}
+
+static uint16_t onOff(struct ControlLoop *loop, temperature_t temperature, temperature_t min)
+{
+    if (temperature < min)
+        return CONTROL_DUTY_MAX;
+    if (temperature >= min + CONTROL_HYSTERESIS)
+        return 0;
+
+    // Inside the band nothing changes
+    return loop->duty;
+}
+
+static uint16_t pid(struct ControlLoop *loop, temperature_t temperature, temperature_t min)
+{
+    int16_t error = min + CONTROL_HYSTERESIS - temperature;
+
+    int32_t proportional = (int32_t)loop->kp * error;
+    int32_t derivative = -(int32_t)loop->kd * (temperature - loop->lastTemp);
+    int32_t integral = loop->integral + (int32_t)loop->ki * error;
+    loop->lastTemp = temperature;
+
+    // The integral alone never asks for more than the full range
+    if (integral > DUTY_MAX_Q8)
+        integral = DUTY_MAX_Q8;
+    else if (integral < 0)
+        integral = 0;
+
+    int32_t output = proportional + integral + derivative;
+
+    // Only keep integrating when the output isn't stuck against a limit
+    // in the direction the error pushes it
+    if (output > DUTY_MAX_Q8)
+    {
+        output = DUTY_MAX_Q8;
+        if (error <= 0)
+            loop->integral = integral;
+    }
+    else if (output < 0)
+    {
+        output = 0;
+        if (error >= 0)
+            loop->integral = integral;
+    }
+    else
+        loop->integral = integral;
+
+    return output >> 8;
+}
+
+void controlTick()
+{
+    BENCH_BEGIN(BENCH_CONTROL);
+
+    for (uint8_t room = 0; room < roomCount; room++)
+    {
+        struct ControlLoop *loop = &loops[room];
+        temperature_t temperature = roomCurrentTemp[room];
+
+        if (loop->secondsInState < 0xFFFF)
+            loop->secondsInState++;
+
+        if (++loop->ticks >= loop->sampleTicks)
+        {
+            loop->ticks = 0;
+
+            if (loop->mode == CONTROL_PID)
+                loop->duty = pid(loop, temperature, roomMinTemp[room]);
+            else
+                loop->duty = onOff(loop, temperature, roomMinTemp[room]);
+        }
+
+        // A PID room goes through lib/pwm, its minimum pulse does the rest
+        if (loop->mode != CONTROL_ONOFF)
+            continue;
+
+        // The ceiling beats everything but the minimum times
+        uint8_t demand = loop->duty > 0 && temperature < roomMaxTemp[room];
+        uint8_t heating = (roomState[room] & ROOM_HEATING) != 0;
+
+        if (demand == heating)
+            continue;
+        if (heating && loop->secondsInState < loop->minOnSeconds)
+            continue;
+        if (!heating && loop->secondsInState < loop->minOffSeconds)
+            continue;
+
+        roomState[room] ^= ROOM_HEATING;
+        loop->secondsInState = 0;
+    }
+
+    BENCH_END(BENCH_CONTROL);
+}
+
+uint16_t getControlDuty(uint8_t room)
+{
+    return room < MAX_NUMBER_OF_ROOMS ? loops[room].duty : 0;
+}
+
+uint16_t getControlOutput(uint8_t room)
+{
+    if (room >= MAX_NUMBER_OF_ROOMS)
+        return 0;
+
+    if (loops[room].mode == CONTROL_ONOFF)
+        return roomState[room] & ROOM_HEATING ? CONTROL_DUTY_MAX : 0;
+
+    return roomCurrentTemp[room] < roomMaxTemp[room] ? loops[room].duty : 0;
+}
@@ -0,0 +1,78 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+#include <rooms.h>
+
+/*
+  Control engine, one loop per room, run by controlTick() every
+  CONTROL_TICK_MS.
+
+  Both modes keep the room between its min and min + CONTROL_HYSTERESIS,
+  max is a ceiling: above it the demand is always 0.
+
+  CONTROL_ONOFF  heats below min, stops at min + CONTROL_HYSTERESIS
+  CONTROL_PID    fixed point PI(D) with the target at min + CONTROL_HYSTERESIS,
+                 the output is a duty cycle in permille ( 0 - CONTROL_DUTY_MAX )
+
+  Every room has its own sample period in ticks, a loop only computes a new
+  output every sampleTicks ticks.
+
+  In on/off mode controlTick() sets ROOM_HEATING, and the heater only
+  switches after it has been on for minOnSeconds or off for minOffSeconds.
+  In PID mode the duty goes to the heater as it is, time proportioned by
+  lib/pwm, whose minimum pulse protects the relay instead. controlTick()
+  leaves ROOM_HEATING alone then, whoever drives the heater sets it from
+  the real output.
+
+  Gains are Q8.8 numbers in permille of duty per tenth of a degree of error,
+  ki is per sample and kd works on the change of the temperature per sample
+  ( no kick when the setpoint changes ). The integral is clamped to the duty
+  range and stops integrating while the output saturates ( anti windup ).
+
+  Cost per room and tick, estimated for avr-gcc -Os: about 80 cycles in
+  on/off mode, about 300 cycles ( 19 us ) on a PID sample, three 16 x 16 bit
+  multiplies and the 32 bit clamps. The bench env measures controlTick()
+  for two PID rooms as BENCH_CONTROL.
+*/
+
+#define CONTROL_ONOFF 0
+#define CONTROL_PID 1
+
+#define CONTROL_TICK_MS 1000
+#define CONTROL_DUTY_MAX 1000
+
+#ifndef CONTROL_HYSTERESIS
+#define CONTROL_HYSTERESIS 5
+#endif
+
+/* Defaults of a new loop */
+#define CONTROL_DEFAULT_KP 12800 /* 50 permille per tenth of a degree */
+#define CONTROL_DEFAULT_KI 256   /* 1 permille per tenth of a degree per sample */
+#define CONTROL_DEFAULT_KD 0
+#define CONTROL_DEFAULT_SAMPLE_TICKS 10
+#define CONTROL_DEFAULT_MIN_ON_S 60
+#define CONTROL_DEFAULT_MIN_OFF_S 60
+
+/* Every room in on/off mode with the defaults */
+void initControl();
+
+void setControlMode(uint8_t room, uint8_t mode);
+uint8_t getControlMode(uint8_t room);
+void setControlGains(uint8_t room, int16_t kp, int16_t ki, int16_t kd);
+void getControlGains(uint8_t room, int16_t *kp, int16_t *ki, int16_t *kd);
+void setControlTiming(uint8_t room, uint8_t sampleTicks, uint16_t minOnSeconds, uint16_t minOffSeconds);
+void getControlTiming(uint8_t room, uint8_t *sampleTicks, uint16_t *minOnSeconds, uint16_t *minOffSeconds);
+
+/* Runs the loops of all rooms, sets ROOM_HEATING of the on/off rooms */
+void controlTick();
+
+/* Last output of a room in permille, 0 or CONTROL_DUTY_MAX in on/off mode */
+uint16_t getControlDuty(uint8_t room);
+
+/* What the heater of a room gets in permille ( see lib/pwm ): ROOM_HEATING in
+   on/off mode, the duty without the minimum times in PID mode, 0 at or above
+   max in both */
+uint16_t getControlOutput(uint8_t room);
+
+#endif
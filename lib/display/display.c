@@ -4,102 +4,233 @@
 #include <ctype.h>
 #include <string.h>
 
-#include <avr/io.h>
-#include <util/delay.h>
+#include <hal.h>
+#include <sram.h>
+#include <profile.h>
 
-const uint8_t ALPHABET_MAP[] = {0x88, 0x83, 0xC6, 0xA1, 0x86, 0x8E, 0xC2,
-                                0x89, 0xCF, 0xE1, 0x8A, 0xC7, 0xEA, 0xC8,
-                                0xC0, 0x8C, 0x4A, 0xCC, 0x92, 0x87, 0xC1,
-                                0xC1, 0xD5, 0x89, 0x91, 0xA4, 0xFF};
+/* Segment bits of a glyph, a segment is lit when its bit is set.
+   The display itself is active low, so glyphs are inverted when written.
 
-const char ALPHABET_CHARS[] = 
-{
-  'a',
-  'b',
-  'c',
-  'd',
-  'e',
-  'f',
-  'g',
-  'h',
-  'i',
-  'j',
-  'k',
-  'l',
-  'm',
-  'n',
-  'o',
-  'p',
-  'q',
-  'r',
-  's',
-  't',
-  'u',
-  'v',
-  'w',
-  'x',
-  'y',
-  'z',
-  ' '
-};
+      a
+    f   b
+      g
+    e   c
+      d   dp
+*/
+#define SEG_A 0x01
+#define SEG_B 0x02
+#define SEG_C 0x04
+#define SEG_D 0x08
+#define SEG_E 0x10
+#define SEG_F 0x20
+#define SEG_G 0x40
+#define SEG_DP 0x80
+
+#define FONT_FIRST ' '
+#define FONT_LAST DEGREE_SIGN
 
-/* Segment byte maps for numbers 0 to 9 */
-const uint8_t SEGMENT_MAP[] = {0xC0, 0xF9, 0xA4, 0xB0, 0x99,
-                               0x92, 0x82, 0xF8, 0X80, 0X90};
+// a letter looks the same in upper and lower case
+#define LETTER(chr, segments) \
+  [(chr) - FONT_FIRST] = (segments), [(chr) - 'a' + 'A' - FONT_FIRST] = (segments)
+
+/* Glyphs for every printable ascii character, indexed by character - FONT_FIRST.
+   Characters that are not listed stay 0 and show up blank. */
+const uint8_t FONT[FONT_LAST - FONT_FIRST + 1] PROGMEM = {
+  ['"' - FONT_FIRST] = SEG_B | SEG_F,
+  ['\'' - FONT_FIRST] = SEG_F,
+  ['-' - FONT_FIRST] = SEG_G,
+  ['.' - FONT_FIRST] = SEG_DP,
+  ['0' - FONT_FIRST] = SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F,
+  ['1' - FONT_FIRST] = SEG_B | SEG_C,
+  ['2' - FONT_FIRST] = SEG_A | SEG_B | SEG_D | SEG_E | SEG_G,
+  ['3' - FONT_FIRST] = SEG_A | SEG_B | SEG_C | SEG_D | SEG_G,
+  ['4' - FONT_FIRST] = SEG_B | SEG_C | SEG_F | SEG_G,
+  ['5' - FONT_FIRST] = SEG_A | SEG_C | SEG_D | SEG_F | SEG_G,
+  ['6' - FONT_FIRST] = SEG_A | SEG_C | SEG_D | SEG_E | SEG_F | SEG_G,
+  ['7' - FONT_FIRST] = SEG_A | SEG_B | SEG_C,
+  ['8' - FONT_FIRST] = SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F | SEG_G,
+  ['9' - FONT_FIRST] = SEG_A | SEG_B | SEG_C | SEG_D | SEG_F | SEG_G,
+  ['=' - FONT_FIRST] = SEG_D | SEG_G,
+  ['?' - FONT_FIRST] = SEG_A | SEG_B | SEG_E | SEG_G,
+  ['[' - FONT_FIRST] = SEG_A | SEG_D | SEG_E | SEG_F,
+  [']' - FONT_FIRST] = SEG_A | SEG_B | SEG_C | SEG_D,
+  ['_' - FONT_FIRST] = SEG_D,
+  LETTER('a', SEG_A | SEG_B | SEG_C | SEG_E | SEG_F | SEG_G),
+  LETTER('b', SEG_C | SEG_D | SEG_E | SEG_F | SEG_G),
+  LETTER('c', SEG_A | SEG_D | SEG_E | SEG_F),
+  LETTER('d', SEG_B | SEG_C | SEG_D | SEG_E | SEG_G),
+  LETTER('e', SEG_A | SEG_D | SEG_E | SEG_F | SEG_G),
+  LETTER('f', SEG_A | SEG_E | SEG_F | SEG_G),
+  LETTER('g', SEG_A | SEG_C | SEG_D | SEG_E | SEG_F),
+  LETTER('h', SEG_B | SEG_C | SEG_E | SEG_F | SEG_G),
+  LETTER('i', SEG_E | SEG_F),
+  LETTER('j', SEG_B | SEG_C | SEG_D | SEG_E),
+  LETTER('k', SEG_A | SEG_C | SEG_E | SEG_F | SEG_G),
+  LETTER('l', SEG_D | SEG_E | SEG_F),
+  LETTER('m', SEG_A | SEG_C | SEG_E),
+  LETTER('n', SEG_A | SEG_B | SEG_C | SEG_E | SEG_F),
+  LETTER('o', SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F),
+  LETTER('p', SEG_A | SEG_B | SEG_E | SEG_F | SEG_G),
+  LETTER('q', SEG_A | SEG_B | SEG_C | SEG_F | SEG_G),
+  LETTER('r', SEG_A | SEG_B | SEG_E | SEG_F),
+  LETTER('s', SEG_A | SEG_C | SEG_D | SEG_F | SEG_G),
+  LETTER('t', SEG_D | SEG_E | SEG_F | SEG_G),
+  LETTER('u', SEG_B | SEG_C | SEG_D | SEG_E | SEG_F),
+  LETTER('v', SEG_B | SEG_C | SEG_D | SEG_E | SEG_F),
+  LETTER('w', SEG_B | SEG_D | SEG_F),
+  LETTER('x', SEG_B | SEG_C | SEG_E | SEG_F | SEG_G),
+  LETTER('y', SEG_B | SEG_C | SEG_D | SEG_F | SEG_G),
+  LETTER('z', SEG_A | SEG_B | SEG_D | SEG_E | SEG_G),
+  [DEGREE_SIGN - FONT_FIRST] = SEG_A | SEG_B | SEG_F | SEG_G,
+};
 
 /* Byte maps to select digit 1 to 4 */
-const uint8_t SEGMENT_SELECT[] = {0xF1, 0xF2, 0xF4, 0xF8};
+const uint8_t SEGMENT_SELECT[] PROGMEM = {0xF1, 0xF2, 0xF4, 0xF8};
+
+/* Segment bytes that are currently on the display, digit 0 is the most left */
+static volatile uint8_t framebuffer[NUMBER_OF_DIGITS] = {BLANK_SEGMENT, BLANK_SEGMENT,
+                                                         BLANK_SEGMENT, BLANK_SEGMENT};
+static uint8_t scanDigit = 0;
+static volatile uint16_t frameCount = 0;
+
+/*
+  Backends that move one digit (segment byte + select byte) into the shift registers.
+
+  Estimated cycles per digit at 16 MHz, latch included, from the instructions
+  each loop needs. They are not measured, the bench env does that: BENCH_SHIFT
+  is one shift() of a byte, BENCH_DISPLAY_REFRESH the four digits of a frame.
+    bit-banged, bitorder tested per bit (previous shift())  ~650 cycles  ~41 us
+    bit-banged, unrolled (default)                          ~150 cycles  ~9 us
+    hardware SPI at F_CPU / 2 (DISPLAY_USE_SPI)             ~50 cycles   ~3 us
+  At DISPLAY_SCAN_RATE 1000 that would be about 4 %, 1 % and 0.3 % of the CPU.
+*/
+#ifdef DISPLAY_USE_SPI
+
+static inline void spiTransfer(uint8_t val) {
+  SPDR = val;
+  loop_until_bit_is_set(SPSR, SPIF);
+}
+
+static inline void writeDigit(uint8_t segments, uint8_t select) {
+  cbi(PORTD, LATCH_DIO);
+  spiTransfer(segments);
+  spiTransfer(select);
+  sbi(PORTD, LATCH_DIO);
+}
+
+#else
+
+void shift(uint8_t val, uint8_t bitorder);
+
+static inline void writeDigit(uint8_t segments, uint8_t select) {
+  cbi(PORTD, LATCH_DIO);
+  shift(segments, MSBFIRST);
+  shift(select, MSBFIRST);
+  sbi(PORTD, LATCH_DIO);
+}
+
+#endif
 
 void initDisplay() {
   sbi(DDRD, LATCH_DIO);
+#ifdef DISPLAY_USE_SPI
+  // SS has to be an output, otherwise a low level on it drops the SPI out of master mode
+  sbi(DDRB, SPI_SS);
+  sbi(DDRB, SPI_MOSI);
+  sbi(DDRB, SPI_SCK);
+  // master, MSB first, mode 0, F_CPU / 2
+  SPCR = _BV(SPE) | _BV(MSTR);
+  SPSR = _BV(SPI2X);
+#else
   sbi(DDRD, CLK_DIO);
   sbi(DDRB, DATA_DIO);
+#endif
+
+  // Timer2 in CTC mode with prescaler 64, one compare match per scanned digit
+  TCCR2A = _BV(WGM21);
+  TCCR2B = _BV(CS22);
+  OCR2A = F_CPU / 64 / DISPLAY_SCAN_RATE - 1;
+  TIMSK2 |= _BV(OCIE2A);
 }
 
-int getHexFromChar(char chr)
-{
-  for (int i = 0; i < sizeof(ALPHABET_CHARS); i++)
-  {
-    if (chr == ALPHABET_CHARS[i])
-    {
-      return i;
-    }
+// shows the next digit of the framebuffer
+void scanDisplay() {
+  writeDigit(framebuffer[scanDigit], pgm_read_byte(&SEGMENT_SELECT[scanDigit]));
+
+  if (++scanDigit >= NUMBER_OF_DIGITS) {
+    scanDigit = 0;
+    frameCount++;
   }
-  return -1;
 }
 
-// loop through seven segments of LED display and shift the correct bits in the
-// data register
-void shift(uint8_t val, uint8_t bitorder) {
-  uint8_t bit;
+ISR(TIMER2_COMPA_vect) {
+  PROFILE_SCOPE(PROFILE_ISR_TIMER2);
+  SRAM_ISR_PROBE(SRAM_ISR_TIMER2);
+  scanDisplay();
+}
 
-  for (uint8_t i = 0; i < NUMBER_OF_SEGMENTS; i++) {
-    if (bitorder == LSBFIRST) {
-      bit = !!(val & (1 << i));
-    } else {
-      bit = !!(val & (1 << (7 - i)));
-    }
-    // write bit to register
-    if (bit == HIGH)
-      sbi(PORTB, DATA_DIO);
-    else
-      cbi(PORTB, DATA_DIO);
+void clearDisplay() {
+  for (uint8_t i = 0; i < NUMBER_OF_DIGITS; i++) {
+    framebuffer[i] = BLANK_SEGMENT;
+  }
+}
 
-    // Trigger the clock pin so the display updates
-    sbi(PORTD, CLK_DIO);
-    cbi(PORTD, CLK_DIO);
+// number of complete refreshes since startup, to measure the refresh rate
+uint16_t getDisplayFrameCount() {
+  uint16_t frames;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    frames = frameCount;
   }
+  return frames;
 }
 
+// looks up the segment byte of a character, unknown characters are blank
+uint8_t getSegmentsFromChar(char chr)
+{
+  uint8_t index = (uint8_t) chr - FONT_FIRST;
+  if (index >= sizeof(FONT)) return BLANK_SEGMENT;
+  return ~pgm_read_byte(&FONT[index]);
+}
+
+#ifndef DISPLAY_USE_SPI
+
+// puts one bit on the data pin and clocks it into the shift register
+#define SHIFT_BIT(val, bit)                 \
+  do {                                      \
+    cbi(PORTB, DATA_DIO);                   \
+    if ((val) & _BV(bit)) sbi(PORTB, DATA_DIO); \
+    sbi(PORTD, CLK_DIO);                    \
+    cbi(PORTD, CLK_DIO);                    \
+  } while (0)
+
+// shift the eight bits of val in the data register, the loop is unrolled and
+// the bit order is only checked once
+void shift(uint8_t val, uint8_t bitorder) {
+  if (bitorder == LSBFIRST) {
+    SHIFT_BIT(val, 0); SHIFT_BIT(val, 1); SHIFT_BIT(val, 2); SHIFT_BIT(val, 3);
+    SHIFT_BIT(val, 4); SHIFT_BIT(val, 5); SHIFT_BIT(val, 6); SHIFT_BIT(val, 7);
+    return;
+  }
+  SHIFT_BIT(val, 7); SHIFT_BIT(val, 6); SHIFT_BIT(val, 5); SHIFT_BIT(val, 4);
+  SHIFT_BIT(val, 3); SHIFT_BIT(val, 2); SHIFT_BIT(val, 1); SHIFT_BIT(val, 0);
+}
+
+#endif
+
 void writeCharToSegment(uint8_t segment, char chr)
 {
-  //printf("Segment %d: %c\n", segment, chr);
-  int index = getHexFromChar(chr);
+  if (segment >= NUMBER_OF_DIGITS) return;
+  framebuffer[segment] = getSegmentsFromChar(chr);
+}
 
-  cbi(PORTD, LATCH_DIO);
-  shift(ALPHABET_MAP[index], MSBFIRST);
-  shift(SEGMENT_SELECT[segment], MSBFIRST);
-  sbi(PORTD, LATCH_DIO);  
+// turns the decimal point of a digit on or off without touching the rest of it
+void writeDecimalPoint(uint8_t segment, uint8_t on)
+{
+  if (segment >= NUMBER_OF_DIGITS) return;
+  if (on)
+    framebuffer[segment] &= (uint8_t) ~SEG_DP;
+  else
+    framebuffer[segment] |= SEG_DP;
 }
 
 void writeString(char string[])
@@ -122,13 +253,11 @@ void writeString(char string[])
 
 //Schrijft cijfer naar bepaald segment. Segment 0 is meest linkse.
 void writeNumberToSegment(uint8_t segment, uint8_t value) {
-  cbi(PORTD, LATCH_DIO);
-  shift(SEGMENT_MAP[value], MSBFIRST);
-  shift(SEGMENT_SELECT[segment], MSBFIRST);
-  sbi(PORTD, LATCH_DIO);
+  if (segment >= NUMBER_OF_DIGITS || value > 9) return;
+  framebuffer[segment] = getSegmentsFromChar('0' + value);
 }
 
-//Schrijft getal tussen 0 en 9999 naar de display. Te gebruiken in een lus...
+//Schrijft getal tussen 0 en 9999 naar de display.
 void writeNumber(int firstNumber, int secondNumber, int decimalNumber) {
   writeNumberToSegment(0, firstNumber);
   writeNumberToSegment(1, secondNumber);
@@ -136,18 +265,89 @@ void writeNumber(int firstNumber, int secondNumber, int decimalNumber) {
   writeCharToSegment(3, 'c');
 }
 
+/* Powers of ten that are subtracted to split a number into decimal digits */
+const uint16_t POWERS_OF_TEN[] PROGMEM = {10000, 1000, 100, 10};
+
+/*
+  Renders a signed fixed point number into NUMBER_OF_DIGITS segment bytes.
+  value 215 with 1 decimal and unit 'c' becomes "21.5c", -50 becomes "-5.0c".
+  Zeros in front of the number are left blank and a minus sign is put in front
+  of the first digit. When the number does not fit, every digit shows a dash.
+  The digits are found by repeated subtraction, so there is no division.
+*/
+void formatFixedPoint(uint8_t segments[], int16_t value, uint8_t decimals, char unit)
+{
+  uint8_t digits = unit ? NUMBER_OF_DIGITS - 1 : NUMBER_OF_DIGITS;
+  if (decimals > digits - 1) decimals = digits - 1;
+
+  uint8_t negative = value < 0;
+  uint16_t magnitude = negative ? -(uint16_t) value : (uint16_t) value;
+
+  uint8_t bcd[5];
+  for (uint8_t i = 0; i < 4; i++) {
+    uint16_t power = pgm_read_word(&POWERS_OF_TEN[i]);
+    uint8_t digit = 0;
+    while (magnitude >= power) {
+      magnitude -= power;
+      digit++;
+    }
+    bcd[i] = digit;
+  }
+  bcd[4] = magnitude;
+
+  // bcd[first] ends up on the most left digit
+  uint8_t first = sizeof(bcd) - digits;
+  uint8_t overflow = 0;
+  for (uint8_t i = 0; i < first; i++) {
+    if (bcd[i]) overflow = 1;
+  }
+
+  // the digit in front of the decimal point is always shown
+  uint8_t position = 0;
+  while (position < digits - 1 - decimals && bcd[first + position] == 0) {
+    segments[position++] = BLANK_SEGMENT;
+  }
+
+  if (negative) {
+    if (position == 0)
+      overflow = 1;
+    else
+      segments[position - 1] = getSegmentsFromChar('-');
+  }
+
+  for (; position < digits; position++) {
+    segments[position] = getSegmentsFromChar('0' + bcd[first + position]);
+  }
+
+  if (overflow) {
+    for (position = 0; position < digits; position++) {
+      segments[position] = getSegmentsFromChar('-');
+    }
+  } else if (decimals) {
+    segments[digits - 1 - decimals] &= (uint8_t) ~SEG_DP;
+  }
+
+  if (unit) segments[NUMBER_OF_DIGITS - 1] = getSegmentsFromChar(unit);
+}
+
+void writeFixedPoint(int16_t value, uint8_t decimals, char unit)
+{
+  uint8_t segments[NUMBER_OF_DIGITS];
+  formatFixedPoint(segments, value, decimals, unit);
+
+  for (uint8_t i = 0; i < NUMBER_OF_DIGITS; i++) {
+    framebuffer[i] = segments[i];
+  }
+}
+
 //Schrijft getal tussen 0 en 9999 naar de display en zorgt dat het er een bepaald aantal milliseconden blijft staan.
-//Opgelet: de timing is "ongeveer", er wordt geen rekening gehouden met de tijd writeNumberToSegment in beslag neemt...
 void writeNumberAndWait(int number, int delay) {
   if (number < 0 || number > 9999) return;
-  for (int i = 0; i < delay / 20; i++) {
-    writeNumberToSegment(0, number / 1000);
-    _delay_ms(5);
-    writeNumberToSegment(1, (number / 100) % 10);
-    _delay_ms(5);
-    writeNumberToSegment(2, (number / 10) % 10);
-    _delay_ms(5);
-    writeNumberToSegment(3, number % 10);
-    _delay_ms(5);
+  writeNumberToSegment(0, number / 1000);
+  writeNumberToSegment(1, (number / 100) % 10);
+  writeNumberToSegment(2, (number / 10) % 10);
+  writeNumberToSegment(3, number % 10);
+  for (int i = 0; i < delay / 10; i++) {
+    _delay_ms(10);
   }
 }
@@ -1,4 +1,8 @@
-#include <avr/io.h>
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stdint.h>
+#include <hal.h>
 
 #define LOW 0
 #define HIGH 1
@@ -7,18 +11,55 @@
 #define CLK_DIO PD7
 #define DATA_DIO PB0
 
+/* Build with -D DISPLAY_USE_SPI to shift the digits out with the hardware SPI.
+   The SPI pins are fixed, so the shift register data and clock inputs have
+   to be wired to MOSI (PB3, D11) and SCK (PB5, D13) instead of DATA_DIO and
+   CLK_DIO. On the multi function shield those pins also drive two of the
+   leds, so this needs a modified board. Without the flag the bits are
+   bit-banged on DATA_DIO and CLK_DIO. */
+#define SPI_SS PB2
+#define SPI_MOSI PB3
+#define SPI_SCK PB5
+
 #define LSBFIRST 0
 #define MSBFIRST 1
 #define NUMBER_OF_SEGMENTS 8
+#define NUMBER_OF_DIGITS 4
+
+/* Digits scanned per second, the whole display refreshes at a quarter of this */
+#ifndef DISPLAY_SCAN_RATE
+#define DISPLAY_SCAN_RATE 1000
+#endif
+
+#define BLANK_SEGMENT 0xFF
+
+/* The font has no room for a real degree sign, it sits on the DEL character */
+#define DEGREE_SIGN '\x7f'
 
 #define sbi(register, bit) (register |= _BV(bit))
 #define cbi(register, bit) (register &= ~_BV(bit))
 
+/* Starts Timer2, which scans the framebuffer out one digit per compare match.
+   The write functions below only change the framebuffer, the digits keep
+   showing until they are overwritten. */
 void initDisplay();
+void scanDisplay();
+void clearDisplay();
+uint16_t getDisplayFrameCount();
+
 void writeNumberToSegment(uint8_t segment, uint8_t value);
 void writeNumber(int firstNumber, int secondNumber, int decimalNumber);
 void writeNumberAndWait(int number, int delay);
 
+/* Signed fixed point numbers: decimals is the number of digits behind the
+   decimal point, unit is the glyph on the last digit or 0 to use all four */
+void formatFixedPoint(uint8_t segments[], int16_t value, uint8_t decimals, char unit);
+void writeFixedPoint(int16_t value, uint8_t decimals, char unit);
+
+uint8_t getSegmentsFromChar(char character);
 void writeCharToSegment(uint8_t segment, char character);
+void writeDecimalPoint(uint8_t segment, uint8_t on);
 void writeString(char* str);
-void writeStringAndWait(char* str, int delay);
\ No newline at end of file
+void writeStringAndWait(char* str, int delay);
+
+#endif
@@ -0,0 +1,63 @@
+#include <hal.h>
+
+#include "events.h"
+
+#if (EVENT_QUEUE_SIZE & (EVENT_QUEUE_SIZE - 1)) || EVENT_QUEUE_SIZE > 256
+#error "EVENT_QUEUE_SIZE must be a power of two, at most 256"
+#endif
+
+#define EVENT_MASK (EVENT_QUEUE_SIZE - 1)
+
+/* Keeps the compiler from moving queue accesses past an index update */
+#define memoryBarrier() __asm__ __volatile__("" ::: "memory")
+
+/* head is only written by the producer, tail only by the consumer. Both are
+   single bytes, so reading them never needs interrupts disabled. */
+static struct Event queue[EVENT_QUEUE_SIZE];
+static volatile uint8_t head = 0;
+static volatile uint8_t tail = 0;
+
+static volatile uint16_t overflows = 0;
+
+uint8_t pushEvent(uint8_t type, uint8_t data)
+{
+    uint8_t index = head;
+    uint8_t next = (index + 1) & EVENT_MASK;
+    if (next == tail)
+    {
+        overflows++;
+        return 0;
+    }
+
+    queue[index].type = type;
+    queue[index].data = data;
+    memoryBarrier();
+    head = next;
+    return 1;
+}
+
+uint8_t popEvent(struct Event *event)
+{
+    uint8_t index = tail;
+    if (index == head) return 0;
+
+    *event = queue[index];
+    memoryBarrier();
+    tail = (index + 1) & EVENT_MASK;
+    return 1;
+}
+
+uint8_t eventsPending()
+{
+    return head != tail;
+}
+
+uint16_t getEventOverflows()
+{
+    uint16_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        count = overflows;
+    }
+    return count;
+}
@@ -0,0 +1,38 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdint.h>
+
+/* Must be a power of two, at most 256 */
+#ifndef EVENT_QUEUE_SIZE
+#define EVENT_QUEUE_SIZE 16
+#endif
+
+/* Event types */
+#define EVENT_BUTTON 1       /* data: button event, see buttons.h */
+#define EVENT_SENSOR_READY 2 /* data: bitmask of the ADC channels with a new result, bit n is ADCn */
+
+struct Event
+{
+    uint8_t type;
+    uint8_t data;
+};
+
+/*
+  Single producer, single consumer queue between the interrupts and the main loop.
+
+  Interrupts push, the main loop pops. Interrupts don't nest on the AVR, so all
+  interrupt handlers together are one producer and no locking is needed. Don't
+  push from the main loop.
+*/
+
+/* Returns 0 and counts an overflow when the queue is full */
+uint8_t pushEvent(uint8_t type, uint8_t data);
+
+/* Returns 0 when there is no event */
+uint8_t popEvent(struct Event *event);
+
+uint8_t eventsPending();
+uint16_t getEventOverflows();
+
+#endif
@@ -0,0 +1,30 @@
+/* Hardware abstraction layer
+
+   Every library and the application include this header instead of the
+   avr-libc headers. On the board it pulls in the real register
+   definitions. Built with -D HAL_NATIVE (the native PlatformIO env) the
+   registers become plain variables in memory, so the firmware can be
+   compiled and run on a pc. See hal_native.h for how interrupts are
+   injected there.
+ */
+#ifndef HAL_H
+#define HAL_H
+
+#ifdef HAL_NATIVE
+
+#include "hal_native.h"
+
+#else
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+#include <util/delay.h>
+
+#endif
+
+#endif
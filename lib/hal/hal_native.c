@@ -0,0 +1,37 @@
+/* Register storage for the native backend, see hal_native.h */
+#ifdef HAL_NATIVE
+
+#include "hal_native.h"
+
+#define HAL_DEFINE_8(name) volatile uint8_t name;
+#define HAL_DEFINE_16(name) volatile uint16_t name;
+HAL_NATIVE_REGISTERS(HAL_DEFINE_8, HAL_DEFINE_16)
+
+uint8_t halEeprom[E2END + 1];
+uint8_t halRam[RAMEND + 1];
+
+#define HAL_CLEAR(name) name = 0;
+
+void halEepromCycle(void)
+{
+    if (!(EECR & _BV(EEPE)))
+        return;
+
+    halEeprom[EEAR] = EEDR;
+    EECR &= ~(_BV(EEPE) | _BV(EEMPE));
+}
+
+void halNativeReset(void)
+{
+    HAL_NATIVE_REGISTERS(HAL_CLEAR, HAL_CLEAR)
+
+    /* Registers that do not reset to zero */
+    UCSR0A = _BV(UDRE0);
+    UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+    SP = RAMEND;
+
+    /* An erased EEPROM reads 0xFF */
+    memset(halEeprom, 0xFF, sizeof(halEeprom));
+}
+
+#endif
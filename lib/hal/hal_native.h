@@ -0,0 +1,331 @@
+/* Native backend of the hardware abstraction layer
+
+   The ATmega328P registers used by the firmware are plain variables here,
+   so the libraries read and write memory instead of hardware. Nothing
+   happens by itself: a test sets the input registers (PINC, ADC, UDR0, ...)
+   and runs interrupt handlers with halRaiseInterrupt(). Delays return
+   immediately.
+ */
+#ifndef HAL_NATIVE_H
+#define HAL_NATIVE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+/* avr-libc sfr_defs.h */
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+#define loop_until_bit_is_set(sfr, bit) do { } while (bit_is_clear(sfr, bit))
+#define loop_until_bit_is_clear(sfr, bit) do { } while (bit_is_set(sfr, bit))
+
+/* Every register the firmware uses, as R8(name) or R16(name) */
+#define HAL_NATIVE_REGISTERS(R8, R16) \
+    /* Ports */ \
+    R8(PINB) R8(DDRB) R8(PORTB) \
+    R8(PINC) R8(DDRC) R8(PORTC) \
+    R8(PIND) R8(DDRD) R8(PORTD) \
+    /* Core */ \
+    R8(SREG) R16(SP) R8(SMCR) R8(MCUSR) R8(MCUCR) R8(PRR) R8(WDTCSR) R8(SPMCSR) \
+    R8(GPIOR0) R8(GPIOR1) R8(GPIOR2) \
+    /* External and pin change interrupts */ \
+    R8(EICRA) R8(EIMSK) R8(EIFR) R8(PCICR) R8(PCIFR) R8(PCMSK0) R8(PCMSK1) R8(PCMSK2) \
+    /* Timers */ \
+    R8(GTCCR) \
+    R8(TCCR0A) R8(TCCR0B) R8(TCNT0) R8(OCR0A) R8(OCR0B) R8(TIMSK0) R8(TIFR0) \
+    R8(TCCR1A) R8(TCCR1B) R8(TCCR1C) R16(TCNT1) R16(ICR1) R16(OCR1A) R16(OCR1B) R8(TIMSK1) R8(TIFR1) \
+    R8(TCCR2A) R8(TCCR2B) R8(TCNT2) R8(OCR2A) R8(OCR2B) R8(TIMSK2) R8(TIFR2) R8(ASSR) \
+    /* ADC, ADC is the 16 bit result the interrupt reads, readADC() reads ADCL and ADCH */ \
+    R16(ADC) R8(ADCL) R8(ADCH) R8(ADCSRA) R8(ADCSRB) R8(ADMUX) R8(DIDR0) \
+    /* SPI */ \
+    R8(SPCR) R8(SPSR) R8(SPDR) \
+    /* USART */ \
+    R8(UCSR0A) R8(UCSR0B) R8(UCSR0C) R8(UBRR0L) R8(UBRR0H) R16(UBRR0) R8(UDR0) \
+    /* EEPROM */ \
+    R8(EECR) R8(EEDR) R16(EEAR)
+
+#define HAL_DECLARE_8(name) extern volatile uint8_t name;
+#define HAL_DECLARE_16(name) extern volatile uint16_t name;
+HAL_NATIVE_REGISTERS(HAL_DECLARE_8, HAL_DECLARE_16)
+
+#define ADCW ADC
+#define RAMSTART 0x0100
+#define RAMEND 0x08FF
+#define E2END 0x3FF
+
+/* Port bits */
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+#define DDB0 0
+#define DDB1 1
+#define DDB2 2
+#define DDB3 3
+#define DDB4 4
+#define DDB5 5
+#define DDD1 1
+#define DDD4 4
+#define DDD7 7
+
+/* Timer 0 */
+#define TOV0 0
+#define OCF0A 1
+#define OCF0B 2
+#define WGM00 0
+#define WGM01 1
+#define COM0B0 4
+#define COM0B1 5
+#define COM0A0 6
+#define COM0A1 7
+#define CS00 0
+#define CS01 1
+#define CS02 2
+#define WGM02 3
+#define TOIE0 0
+#define OCIE0A 1
+#define OCIE0B 2
+
+/* Timer 1 */
+#define TOV1 0
+#define OCF1A 1
+#define OCF1B 2
+#define ICF1 5
+#define WGM10 0
+#define WGM11 1
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define WGM13 4
+#define TOIE1 0
+#define OCIE1A 1
+#define OCIE1B 2
+#define ICIE1 5
+
+/* Timer 2 */
+#define TOV2 0
+#define OCF2A 1
+#define OCF2B 2
+#define WGM20 0
+#define WGM21 1
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define WGM22 3
+#define TOIE2 0
+#define OCIE2A 1
+#define OCIE2B 2
+
+/* SPI */
+#define SPR0 0
+#define SPR1 1
+#define CPHA 2
+#define CPOL 3
+#define MSTR 4
+#define DORD 5
+#define SPE 6
+#define SPIE 7
+#define SPI2X 0
+#define WCOL 6
+#define SPIF 7
+
+/* Sleep */
+#define SE 0
+#define SM0 1
+#define SM1 2
+#define SM2 3
+
+/* Pin change interrupts */
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+#define PCINT9 1
+#define PCINT10 2
+#define PCINT11 3
+
+/* ADC */
+#define MUX0 0
+#define MUX1 1
+#define MUX2 2
+#define MUX3 3
+#define ADLAR 5
+#define REFS0 6
+#define REFS1 7
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADATE 5
+#define ADSC 6
+#define ADEN 7
+#define ADTS0 0
+#define ADTS1 1
+#define ADTS2 2
+#define ACME 6
+
+/* USART */
+#define MPCM0 0
+#define U2X0 1
+#define UPE0 2
+#define DOR0 3
+#define FE0 4
+#define UDRE0 5
+#define TXC0 6
+#define RXC0 7
+#define TXB80 0
+#define RXB80 1
+#define UCSZ02 2
+#define TXEN0 3
+#define RXEN0 4
+#define UDRIE0 5
+#define TXCIE0 6
+#define RXCIE0 7
+#define UCPOL0 0
+#define UCSZ00 1
+#define UCSZ01 2
+#define UCPHA0 1
+#define UDORD0 2
+#define USBS0 3
+#define UPM00 4
+#define UPM01 5
+#define UMSEL00 6
+#define UMSEL01 7
+
+/* EEPROM */
+#define EERE 0
+#define EEPE 1
+#define EEMPE 2
+#define EERIE 3
+#define EEPM0 4
+#define EEPM1 5
+
+/* Power reduction and status register */
+#define PRADC 0
+#define PRUSART0 1
+#define PRSPI 2
+#define PRTIM1 3
+#define PRTIM0 5
+#define PRTIM2 6
+#define PRTWI 7
+#define SREG_I 7
+
+/* avr/interrupt.h, a handler is an ordinary function named after its vector */
+#define ISR(vector, ...) void vector(void); void vector(void)
+#define EMPTY_INTERRUPT(vector) void vector(void); void vector(void) {}
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define sei() (SREG |= _BV(SREG_I))
+#define cli() (SREG &= ~_BV(SREG_I))
+
+/* Runs an interrupt handler the way the hardware would: only when interrupts
+   are enabled, and with interrupts disabled while it runs */
+#define halRaiseInterrupt(vector)           \
+    do {                                    \
+        void vector(void);                  \
+        if (SREG & _BV(SREG_I)) {           \
+            SREG &= ~_BV(SREG_I);           \
+            vector();                       \
+            SREG |= _BV(SREG_I);            \
+        }                                   \
+    } while (0)
+
+/* util/atomic.h */
+static inline uint8_t halAtomicEnter(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    return sreg;
+}
+
+static inline void halAtomicLeave(const uint8_t *sreg)
+{
+    SREG = *sreg;
+}
+
+/* Like avr-libc the interrupt flag is restored however the block is left */
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type)                                                          \
+    for (uint8_t halSreg __attribute__((__cleanup__(halAtomicLeave))) = halAtomicEnter(), \
+         halOnce = 1; halOnce; halOnce = 0)
+
+/* avr/pgmspace.h, flash is ordinary memory */
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(address) (*(const uint8_t *) (address))
+#define pgm_read_word(address) (*(const uint16_t *) (address))
+#define pgm_read_ptr(address) (*(void * const *) (address))
+#define memcpy_P memcpy
+#define strcmp_P strcmp
+#define strlen_P strlen
+
+/* avr/eeprom.h, the EEPROM is an array. Writes go through the registers
+   like on the chip, halEepromCycle() finishes one the way the hardware would. */
+extern uint8_t halEeprom[E2END + 1];
+#define EEMEM
+#define eeprom_busy_wait() do { } while (0)
+#define eeprom_read_byte(address) (halEeprom[(uintptr_t) (address)])
+#define eeprom_read_block(destination, source, length) \
+    memcpy((destination), &halEeprom[(uintptr_t) (source)], (length))
+void halEepromCycle(void);
+
+/* The SRAM of the chip for code that looks at it byte by byte ( lib/sram ),
+   SP points into it like on the chip */
+extern uint8_t halRam[RAMEND + 1];
+
+/* util/delay.h */
+#define _delay_ms(ms) ((void) (ms))
+#define _delay_us(us) ((void) (us))
+
+/* avr/sleep.h, sleeping returns right away, there is nothing to wait for */
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_ADC _BV(SM0)
+#define SLEEP_MODE_PWR_DOWN _BV(SM1)
+#define set_sleep_mode(mode) (SMCR = (SMCR & ~(_BV(SM0) | _BV(SM1) | _BV(SM2))) | (mode))
+#define sleep_enable() (SMCR |= _BV(SE))
+#define sleep_disable() (SMCR &= ~_BV(SE))
+#define sleep_cpu() do { } while (0)
+
+/* util/crc16.h, the same bit by bit algorithm the avr-libc docs give for it */
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+    data ^= crc & 0xFF;
+    data ^= data << 4;
+    return ((((uint16_t) data << 8) | (crc >> 8)) ^ (uint8_t) (data >> 4) ^ ((uint16_t) data << 3));
+}
+
+/* util/setbaud.h, evaluated where BAUD is known */
+#define UBRR_VALUE ((F_CPU + 8UL * BAUD) / (16UL * BAUD) - 1UL)
+#define UBRRH_VALUE (UBRR_VALUE >> 8)
+#define UBRRL_VALUE (UBRR_VALUE & 0xFF)
+#define USE_2X 0
+
+/* Puts every register back to its reset value, call it before each test */
+void halNativeReset(void);
+
+#endif
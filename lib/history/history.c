@@ -0,0 +1,195 @@
+#include <string.h>
+
+#include <hal.h>
+
+#include "history.h"
+
+#define SECONDS_PER_MINUTE 60
+#define MINUTES_PER_QUARTER 15
+
+struct Ring
+{
+    temperature_t newest;
+    uint8_t head; /* index of the newest entry */
+    uint8_t count;
+};
+
+// Min, max and sum of the samples of the bucket that is being filled
+struct Accumulator
+{
+    int32_t sum;
+    temperature_t min;
+    temperature_t max;
+    uint8_t samples;
+};
+
+// The change of the average to the bucket before and how far min and max are from it
+struct Bucket
+{
+    int8_t change;
+    int8_t min;
+    int8_t max;
+};
+
+struct RoomHistory
+{
+    int8_t seconds[HISTORY_SECONDS];
+    struct Bucket minutes[HISTORY_MINUTES];
+    struct Bucket quarters[HISTORY_QUARTERS];
+    struct Ring rings[HISTORY_TIERS];
+    struct Accumulator minute;
+    struct Accumulator quarter;
+};
+
+static struct RoomHistory histories[MAX_NUMBER_OF_ROOMS];
+
+_Static_assert(sizeof(histories) <= HISTORY_BUDGET, "history does not fit in HISTORY_BUDGET");
+
+static const uint8_t RING_SIZES[HISTORY_TIERS] PROGMEM = {HISTORY_SECONDS, HISTORY_MINUTES, HISTORY_QUARTERS};
+
+void initHistory()
+{
+    memset(histories, 0, sizeof(histories));
+}
+
+static int8_t clampToInt8(int16_t value)
+{
+    if (value > INT8_MAX)
+        return INT8_MAX;
+    if (value < INT8_MIN)
+        return INT8_MIN;
+    return value;
+}
+
+// Adds the value to the ring, returns the change to the previous entry
+static int8_t push(struct Ring *ring, uint8_t size, temperature_t value)
+{
+    int8_t change = clampToInt8(ring->count ? value - ring->newest : 0);
+
+    if (ring->count)
+        ring->head = ring->head + 1 < size ? ring->head + 1 : 0;
+    if (ring->count < size)
+        ring->count++;
+
+    ring->newest = ring->count > 1 ? ring->newest + change : value;
+    return change;
+}
+
+static void accumulate(struct Accumulator *accumulator, temperature_t average, temperature_t min, temperature_t max)
+{
+    if (!accumulator->samples || min < accumulator->min)
+        accumulator->min = min;
+    if (!accumulator->samples || max > accumulator->max)
+        accumulator->max = max;
+
+    accumulator->sum += average;
+    accumulator->samples++;
+}
+
+/*
+
+Turns the accumulator into a bucket of the ring and starts it over
+
+@return the average of the bucket
+
+*/
+static temperature_t finish(struct Accumulator *accumulator, struct Ring *ring, struct Bucket *buckets, uint8_t size)
+{
+    int32_t half = accumulator->samples / 2;
+    temperature_t average = (accumulator->sum + (accumulator->sum < 0 ? -half : half)) / accumulator->samples;
+
+    int8_t change = push(ring, size, average);
+    struct Bucket *bucket = &buckets[ring->head];
+
+    // Min and max from the average as it is stored
+    bucket->change = change;
+    bucket->min = clampToInt8(accumulator->min - ring->newest);
+    bucket->max = clampToInt8(accumulator->max - ring->newest);
+
+    accumulator->sum = 0;
+    accumulator->samples = 0;
+    return average;
+}
+
+uint8_t historyTick()
+{
+    uint8_t quarterDone = 0;
+
+    for (uint8_t room = 0; room < roomCount; room++)
+    {
+        struct RoomHistory *history = &histories[room];
+        temperature_t temperature = roomCurrentTemp[room];
+
+        int8_t change = push(&history->rings[HISTORY_TIER_SECONDS], HISTORY_SECONDS, temperature);
+        history->seconds[history->rings[HISTORY_TIER_SECONDS].head] = change;
+        accumulate(&history->minute, temperature, temperature, temperature);
+
+        if (history->minute.samples < SECONDS_PER_MINUTE)
+            continue;
+
+        temperature_t min = history->minute.min;
+        temperature_t max = history->minute.max;
+        temperature_t average = finish(&history->minute, &history->rings[HISTORY_TIER_MINUTES],
+                                       history->minutes, HISTORY_MINUTES);
+        accumulate(&history->quarter, average, min, max);
+
+        if (history->quarter.samples < MINUTES_PER_QUARTER)
+            continue;
+
+        finish(&history->quarter, &history->rings[HISTORY_TIER_QUARTERS],
+               history->quarters, HISTORY_QUARTERS);
+        quarterDone = 1;
+    }
+
+    return quarterDone;
+}
+
+uint8_t getHistoryCount(uint8_t room, uint8_t tier)
+{
+    if (room >= MAX_NUMBER_OF_ROOMS || tier >= HISTORY_TIERS)
+        return 0;
+    return histories[room].rings[tier].count;
+}
+
+// The seconds ring has no buckets, only the changes
+static const struct Bucket *bucketAt(const struct RoomHistory *history, uint8_t tier, uint8_t index)
+{
+    return tier == HISTORY_TIER_MINUTES ? &history->minutes[index] : &history->quarters[index];
+}
+
+static int8_t changeAt(const struct RoomHistory *history, uint8_t tier, uint8_t index)
+{
+    if (tier == HISTORY_TIER_SECONDS)
+        return history->seconds[index];
+    return bucketAt(history, tier, index)->change;
+}
+
+uint8_t getHistory(uint8_t room, uint8_t tier, uint8_t age, struct HistoryEntry *entry)
+{
+    if (age >= getHistoryCount(room, tier))
+        return 0;
+
+    const struct RoomHistory *history = &histories[room];
+    const struct Ring *ring = &history->rings[tier];
+    uint8_t size = pgm_read_byte(&RING_SIZES[tier]);
+
+    // Undo the changes of the newer entries
+    temperature_t average = ring->newest;
+    uint8_t index = ring->head;
+    for (; age; age--)
+    {
+        average -= changeAt(history, tier, index);
+        index = index ? index - 1 : size - 1;
+    }
+
+    entry->average = average;
+    entry->min = average;
+    entry->max = average;
+    if (tier != HISTORY_TIER_SECONDS)
+    {
+        const struct Bucket *bucket = bucketAt(history, tier, index);
+        entry->min += bucket->min;
+        entry->max += bucket->max;
+    }
+    return 1;
+}
@@ -0,0 +1,86 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <rooms.h>
+
+/*
+  Temperature history of every room in a fixed amount of SRAM.
+
+  historyTick() takes the temperature of every room once per second. The
+  samples go to three rings per room, each one coarser than the one before:
+
+  HISTORY_TIER_SECONDS   the last HISTORY_SECONDS samples
+  HISTORY_TIER_MINUTES   min, average and max of the last HISTORY_MINUTES minutes
+  HISTORY_TIER_QUARTERS  the same per 15 minutes, HISTORY_QUARTERS of them
+
+  A ring only keeps its newest value in full. Every entry holds the change of
+  its average to the entry before it as an int8 in tenths of a degree, a
+  bucket adds how far min and max are from the average as two more int8. A
+  change of more than 12.7 degrees per entry is clamped, the chain follows
+  over the next entries. Min and max are clamped to 12.8 degrees below and
+  12.7 above the average, only then do they come out too narrow.
+
+  Entries are found by walking back from the newest one, age 0, which costs
+  one add per entry.
+*/
+
+#define HISTORY_TIER_SECONDS 0
+#define HISTORY_TIER_MINUTES 1
+#define HISTORY_TIER_QUARTERS 2
+#define HISTORY_TIERS 3
+
+/* The build fails when the history of all rooms grows past this many bytes of SRAM */
+#ifndef HISTORY_BUDGET
+#define HISTORY_BUDGET 800
+#endif
+
+#ifndef HISTORY_SECONDS
+#define HISTORY_SECONDS 16
+#endif
+
+/* Two rooms get 20 minutes and 24 hours. With more rooms the minutes go down
+   to 10 and the quarters share what is left of HISTORY_BUDGET, which is far
+   less than 24 hours: 15 h for three rooms, 9.5 h for four and 1 h for
+   eight. A bucket takes 3 bytes, every room also needs HISTORY_SECONDS plus
+   up to 40 bytes for the rings, the buckets being filled and padding. */
+#if MAX_NUMBER_OF_ROOMS <= 2
+
+#ifndef HISTORY_MINUTES
+#define HISTORY_MINUTES 20
+#endif
+#ifndef HISTORY_QUARTERS
+#define HISTORY_QUARTERS 96
+#endif
+
+#else
+
+#ifndef HISTORY_MINUTES
+#define HISTORY_MINUTES 10
+#endif
+#ifndef HISTORY_QUARTERS
+#define HISTORY_QUARTERS ((HISTORY_BUDGET / MAX_NUMBER_OF_ROOMS - HISTORY_SECONDS - 40 - 3 * HISTORY_MINUTES) / 3)
+#endif
+
+#endif
+
+struct HistoryEntry
+{
+    temperature_t min;
+    temperature_t average;
+    temperature_t max;
+};
+
+/* Forgets everything */
+void initHistory();
+
+/* Call once per second, returns 1 when a 15 minute bucket was finished */
+uint8_t historyTick();
+
+/* Entries a tier of a room holds right now */
+uint8_t getHistoryCount(uint8_t room, uint8_t tier);
+
+/* Entry age of a tier, 0 is the newest, returns 0 when there is no such entry */
+uint8_t getHistory(uint8_t room, uint8_t tier, uint8_t age, struct HistoryEntry *entry);
+
+#endif
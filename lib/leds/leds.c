@@ -1,6 +1,6 @@
-#include <avr/io.h>
+#include <hal.h>
 
-#define NUMBER_OF_LEDS 4
+#include "leds.h"
 
 #define LED_DDR DDRB
 #define LED_PORT PORTB
@@ -8,78 +8,164 @@
 #define LED1 PB2
 #define LED2 PB3
 #define LED3 PB4
-#define LED4 PB4
+#define LED4 PB5
 
-// enables specific led and enables the LED PORT so the led stays down
+#define LED_MASK (_BV(LED1) | _BV(LED2) | _BV(LED3) | _BV(LED4))
+
+static outputs_t staged = 0;
+static outputs_t committed = 0;
+static uint8_t outputsValid = 0;
+
+#if OUTPUT_SHIFT_REGISTERS
+// Clocks a byte into the chain, Q7 first
+static void shiftOutputByte(uint8_t value)
+{
+    for (uint8_t bit = 0x80; bit; bit >>= 1)
+    {
+        if (value & bit)
+            OUTPUT_SR_PORT |= _BV(OUTPUT_SR_DATA);
+        else
+            OUTPUT_SR_PORT &= ~_BV(OUTPUT_SR_DATA);
+
+        OUTPUT_SR_PORT |= _BV(OUTPUT_SR_CLOCK);
+        OUTPUT_SR_PORT &= ~_BV(OUTPUT_SR_CLOCK);
+    }
+}
+#endif
+
+// Call with interrupts off
+static void writeOutputs(outputs_t outputs)
+{
+    // The LEDs are active low, the other PORTB pins belong to the display
+    uint8_t leds = (uint8_t)(~outputs & 0x0F) << LED1;
+    LED_PORT = (LED_PORT & ~LED_MASK) | leds;
+
+#if OUTPUT_SHIFT_REGISTERS
+    // The last register of the chain goes first
+    for (int8_t i = OUTPUT_SHIFT_REGISTERS - 1; i >= 0; i--)
+        shiftOutputByte(outputs >> (NUMBER_OF_LEDS + 8 * i));
+
+    // Every output changes at the same moment on the rising edge of the latch
+    OUTPUT_SR_PORT |= _BV(OUTPUT_SR_LATCH);
+    OUTPUT_SR_PORT &= ~_BV(OUTPUT_SR_LATCH);
+#endif
+
+    committed = outputs;
+    outputsValid = 1;
+}
+
+void initOutputs()
+{
+    LED_DDR |= LED_MASK;
+
+#if OUTPUT_SHIFT_REGISTERS
+    OUTPUT_SR_DDR |= _BV(OUTPUT_SR_DATA) | _BV(OUTPUT_SR_CLOCK) | _BV(OUTPUT_SR_LATCH);
+#endif
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        staged = 0;
+        writeOutputs(staged);
+    }
+}
+
+// The outputs are changed from the main loop and from the tick interrupt
+// ( lib/pwm ), every access to the masks is atomic
+
+void setOutputs(outputs_t outputs)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        staged = outputs;
+    }
+}
+
+void setOutput(uint8_t output, uint8_t on)
+{
+    if (output >= NUMBER_OF_OUTPUTS) return;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (on)
+            staged |= (outputs_t)1 << output;
+        else
+            staged &= ~((outputs_t)1 << output);
+    }
+}
+
+outputs_t getOutputs()
+{
+    outputs_t outputs;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        outputs = staged;
+    }
+    return outputs;
+}
+
+void commitOutputs()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (!outputsValid || staged != committed)
+            writeOutputs(staged);
+    }
+}
+
+// enables specific led, it stays down
 void enableLed(int led)
 {
     if (led < 0 || led > NUMBER_OF_LEDS - 1) return;
-    LED_DDR |= (1 << (PB2 + led));
-    LED_PORT |= (1 << (PB2 + led));
+    LED_DDR |= (1 << (LED1 + led));
+    setOutput(led, 0);
+    commitOutputs();
 }
 
-// enables all leds and enables the LED PORT so the led stays down
+// enables all outputs, they stay down
 void enableAllLeds()
 {
-    for (int i = 0; i < NUMBER_OF_LEDS; i++)
-    {
-        LED_DDR |= (1 << (PB2 + i));
-        LED_PORT |= (1 << (PB2 + i));
-    }
+    initOutputs();
 }
 
 // turns on specific led
 void turnLedOn(int led)
 {
-    if (led < 0 || led > NUMBER_OF_LEDS -1 ) return;
-    LED_PORT &= ~(1 << (PB2 + led));
+    if (led < 0 || led > NUMBER_OF_OUTPUTS - 1) return;
+    setOutput(led, 1);
+    commitOutputs();
 }
 
 // turns on all leds
 void turnOnAllLeds()
 {
-    for (int i = 0; i < NUMBER_OF_LEDS; i++)
-    {
-        LED_PORT &= ~(1 << (PB2 + i));
-    }
+    setOutputs(~(outputs_t)0);
+    commitOutputs();
 }
 
 // turns down specific led
 void turnDownLed(int led)
 {
-    if (led < 0 || led > NUMBER_OF_LEDS - 1) return;
-    LED_PORT |= (1 << (PB2 + led));
+    if (led < 0 || led > NUMBER_OF_OUTPUTS - 1) return;
+    setOutput(led, 0);
+    commitOutputs();
 }
 
 // turns down all leds
 void turnDownAllLeds()
 {
-    for (int i = 0; i < NUMBER_OF_LEDS; i++)
-    {
-        LED_PORT |= (1 << (PB2 + i));
-    }
+    setOutputs(0);
+    commitOutputs();
 }
 
 // checks the status of a specific led
 int getLedStatus(int led)
 {
-    if (bit_is_clear(LED_PORT, (PB2 + led)))
-    {
-        return 1;
-    }
-    return 0;
+    if (led < 0 || led > NUMBER_OF_OUTPUTS - 1) return 0;
+    return (getOutputs() >> led) & 1;
 }
 
 // returns 1 if one of the leds is turned on
 int getAllLedsStatus()
 {
-    for (int i = 0; i < NUMBER_OF_LEDS; i++)
-    {
-        if (bit_is_clear(LED_PORT, (PB2 + i)))
-        {
-            return 1;
-        }
-        continue;
-    }
-    return 0;
-}
\ No newline at end of file
+    return getOutputs() != 0;
+}
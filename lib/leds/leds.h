@@ -1,6 +1,56 @@
 #ifndef LEDS_H
 #define LEDS_H
 
+#include <stdint.h>
+
+#define NUMBER_OF_LEDS 4
+
+/*
+  Output bank: the four on-board LEDs plus the outputs of daisy chained
+  74HC595 shift registers, one bit per output in an outputs_t.
+
+  Outputs 0-3 are the LEDs on PB2-PB5 ( active low on the board, a 1 in the
+  mask is always on ), outputs 4 and up are Q0-Q7 of the first shift
+  register, then the second one and so on. Build with
+  -D OUTPUT_SHIFT_REGISTERS=2 for two of them, 20 outputs in total.
+
+  Changes are staged with setOutput() / setOutputs() and go out together in
+  commitOutputs(): one write of PORTB and one latch of the shift registers.
+  They can be called from interrupt handlers too.
+*/
+#ifndef OUTPUT_SHIFT_REGISTERS
+#define OUTPUT_SHIFT_REGISTERS 0
+#endif
+
+#define NUMBER_OF_OUTPUTS (NUMBER_OF_LEDS + 8 * OUTPUT_SHIFT_REGISTERS)
+
+// Pins of the shift register chain, free pins of the multifunction shield
+#define OUTPUT_SR_DDR DDRD
+#define OUTPUT_SR_PORT PORTD
+#define OUTPUT_SR_DATA PD5
+#define OUTPUT_SR_CLOCK PD6
+#define OUTPUT_SR_LATCH PD2
+
+#if NUMBER_OF_OUTPUTS <= 8
+typedef uint8_t outputs_t;
+#elif NUMBER_OF_OUTPUTS <= 16
+typedef uint16_t outputs_t;
+#elif NUMBER_OF_OUTPUTS <= 32
+typedef uint32_t outputs_t;
+#else
+#error "At most 32 outputs, lower OUTPUT_SHIFT_REGISTERS"
+#endif
+
+// Sets the pins up and turns every output off
+void initOutputs();
+
+void setOutputs(outputs_t outputs);
+void setOutput(uint8_t output, uint8_t on);
+outputs_t getOutputs();
+
+// Sends the staged outputs, does nothing when they did not change
+void commitOutputs();
+
 // enable leds
 void enableLed(int led);
 void enableAllLeds();
@@ -17,4 +67,4 @@ void turnDownAllLeds();
 int getLedStatus(int led);
 int getAllLedsStatus();
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,48 @@
+#include <hal.h>
+#include <scheduler.h>
+
+#include "power.h"
+
+static uint32_t sleptMicros = 0;
+static uint32_t windowStart = 0;
+
+void sleepUntilInterrupt(uint8_t adcConverting)
+{
+#ifdef POWER_ADC_NOISE_REDUCTION
+    set_sleep_mode(adcConverting ? SLEEP_MODE_ADC : SLEEP_MODE_IDLE);
+#else
+    set_sleep_mode(SLEEP_MODE_IDLE);
+#endif
+
+    uint32_t start = micros();
+
+    sleep_enable();
+    // The instruction after sei() always runs before an interrupt,
+    // so a wake up can't get lost between here and the sleep
+    sei();
+    sleep_cpu();
+    sleep_disable();
+
+    // Runs after the interrupt that woke us up, its handler counts as sleep
+    sleptMicros += micros() - start;
+}
+
+uint16_t getCpuLoad()
+{
+    uint32_t now = micros();
+    uint32_t window = now - windowStart;
+    uint32_t slept = sleptMicros;
+
+    windowStart = now;
+    sleptMicros = 0;
+
+    if (slept >= window)
+        return 0;
+
+    uint32_t microsPerPermille = window / 1000;
+    if (microsPerPermille == 0)
+        return 1000;
+
+    uint32_t load = (window - slept) / microsPerPermille;
+    return load > 1000 ? 1000 : load;
+}
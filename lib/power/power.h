@@ -0,0 +1,30 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+/*
+  Puts the cpu to sleep while there is nothing to do.
+
+  IDLE stops only the cpu clock, so the 1 ms tick, the display scan, the
+  USART and the pin change interrupt of the buttons all keep running and
+  wake it up again.
+
+  Build with -D POWER_ADC_NOISE_REDUCTION to sleep in ADC Noise Reduction
+  mode while a conversion runs. That mode also stops Timer0 and Timer2: the
+  millisecond clock falls behind by the time spent in it, and the display
+  goes dark for a moment on every conversion. The USART stops with clkI/O
+  too, so serial output pauses until the conversion is done. Only the ADC
+  and pin changes can wake the cpu then. Leave it off unless the readings
+  are too noisy.
+*/
+
+/* Call with interrupts disabled after checking there is no work left, so
+   an interrupt can't slip in between the check and the sleep. Returns
+   with interrupts enabled once an interrupt has woken the cpu. */
+void sleepUntilInterrupt(uint8_t adcConverting);
+
+/* Time the cpu was awake since the previous call, in permille */
+uint16_t getCpuLoad();
+
+#endif
@@ -0,0 +1,150 @@
+#ifdef PROFILE
+
+#include <string.h>
+
+#include "profile.h"
+
+// Cycles below 2^FIRST_BUCKET_SHIFT land in the first bucket
+#define FIRST_BUCKET_SHIFT 6
+
+struct Profile
+{
+    struct ProfileStats stats;
+    uint32_t lastStartHigh;
+    uint16_t lastStart;
+};
+
+static struct Profile profiles[PROFILE_IDS];
+
+// High bits of the time stamps the periods come from
+static volatile uint32_t overflows = 0;
+
+// Cycles of an empty region
+static uint16_t overhead = 0;
+
+void initProfiler()
+{
+    // Normal mode, no prescaler
+    PRR &= ~_BV(PRTIM1);
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10);
+    TIMSK1 = _BV(TOIE1);
+
+    resetProfile();
+
+    // Measure the markers with interrupts off, so nothing gets in between
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        overhead = 0;
+        PROFILE_ENTER(PROFILE_MAIN_LOOP);
+        PROFILE_LEAVE(PROFILE_MAIN_LOOP);
+        overhead = profiles[PROFILE_MAIN_LOOP].stats.min;
+    }
+
+    resetProfile();
+}
+
+ISR(TIMER1_OVF_vect)
+{
+    overflows++;
+}
+
+// Cycles from the previous start of the id, saturated at INT32_MAX
+static uint32_t period(const struct Profile *profile, uint32_t startHigh, uint16_t start)
+{
+    uint32_t high = startHigh - profile->lastStartHigh;
+    if (high >= 0x7FFF)
+        return INT32_MAX;
+    return (high << 16) + start - profile->lastStart;
+}
+
+static uint8_t bucket(uint16_t cycles)
+{
+    uint8_t index = 0;
+
+    cycles >>= FIRST_BUCKET_SHIFT;
+    while (cycles && index < PROFILE_BUCKETS - 1)
+    {
+        cycles >>= 1;
+        index++;
+    }
+    return index;
+}
+
+void profileRecord(uint8_t id, uint16_t start)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        uint16_t now = TCNT1;
+        uint32_t nowHigh = overflows;
+
+        // Timer1 wrapped but the interrupt did not run yet
+        if ((TIFR1 & _BV(TOV1)) && now < 0x8000)
+            nowHigh++;
+
+        uint16_t cycles = now - start;
+        uint32_t startHigh = start > now ? nowHigh - 1 : nowHigh;
+        cycles = cycles > overhead ? cycles - overhead : 0;
+
+        struct Profile *profile = &profiles[id];
+        struct ProfileStats *stats = &profile->stats;
+
+        if (stats->count)
+        {
+            uint32_t cyclesBetween = period(profile, startHigh, start);
+            if (cyclesBetween < stats->minPeriod)
+                stats->minPeriod = cyclesBetween;
+            if (cyclesBetween > stats->maxPeriod)
+                stats->maxPeriod = cyclesBetween;
+        }
+        profile->lastStartHigh = startHigh;
+        profile->lastStart = start;
+
+        if (!stats->count || cycles < stats->min)
+            stats->min = cycles;
+        if (cycles > stats->max)
+            stats->max = cycles;
+        stats->count++;
+
+        if (stats->sum > UINT32_MAX - cycles)
+        {
+            stats->sum >>= 1;
+            stats->sumCount >>= 1;
+        }
+        stats->sum += cycles;
+        stats->sumCount++;
+
+        uint16_t *counter = &stats->buckets[bucket(cycles)];
+        if (*counter == 0xFFFF)
+        {
+            for (uint8_t i = 0; i < PROFILE_BUCKETS; i++)
+                stats->buckets[i] >>= 1;
+        }
+        (*counter)++;
+    }
+}
+
+uint8_t getProfile(uint8_t id, struct ProfileStats *stats)
+{
+    if (id >= PROFILE_IDS)
+        return 0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memcpy(stats, &profiles[id].stats, sizeof(*stats));
+    }
+    return stats->count > 0;
+}
+
+void resetProfile()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memset(profiles, 0, sizeof(profiles));
+
+        for (uint8_t id = 0; id < PROFILE_IDS; id++)
+            profiles[id].stats.minPeriod = INT32_MAX;
+    }
+}
+
+#endif
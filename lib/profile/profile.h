@@ -0,0 +1,108 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <hal.h>
+
+/*
+  Cycle profiler for interrupt handlers and regions of the main loop.
+
+  Build with -D PROFILE. Timer1 then runs free at the cpu clock, and
+  PROFILE_ENTER / PROFILE_LEAVE take its count at both ends of a region.
+  PROFILE_SCOPE at the top of an interrupt handler records everything up
+  to the end of the handler, whichever return it takes. The register saves
+  and the reti of the handler are not in it.
+  Per id the profiler keeps:
+  - how often the region ran,
+  - min, average and max cycles,
+  - a histogram of the cycles in PROFILE_BUCKETS powers of two, starting
+    below 64 cycles and ending at 4096 and up,
+  - min and max cycles between two entries, the jitter of a periodic
+    interrupt.
+
+  Timer1 wraps every 65536 cycles (4.1 ms), so a region has to be shorter.
+  The time between two entries can be longer: the Timer1 overflow interrupt
+  counts the wraps, which makes 32 bit time stamps for the periods. A period
+  of 2^31 cycles (134 s) or more reads INT32_MAX. A region of the main loop also counts the interrupts that hit it. The
+  cycles of the markers themselves are measured by initProfiler() and taken
+  off.
+
+  In every other build the markers are empty and Timer1 stays off.
+
+  An id is used from one place only: an interrupt handler or the main loop.
+*/
+
+#define PROFILE_ISR_TIMER0 0
+#define PROFILE_ISR_TIMER2 1
+#define PROFILE_ISR_ADC 2
+#define PROFILE_ISR_USART_TX 3
+#define PROFILE_ISR_USART_RX 4
+#define PROFILE_ISR_EEPROM 5
+#define PROFILE_MAIN_LOOP 6 /* one pass of the main loop without the sleep */
+#define PROFILE_TASKS 7     /* runTasks() */
+#define PROFILE_IDS 8
+
+#define PROFILE_BUCKETS 8
+
+struct ProfileStats
+{
+    uint32_t count;
+    uint32_t sum;      /* of the cycles of sumCount runs, */
+    uint32_t sumCount; /* both are halved before sum overflows */
+    uint16_t min;
+    uint16_t max;
+    uint32_t minPeriod;
+    uint32_t maxPeriod;
+    uint16_t buckets[PROFILE_BUCKETS]; /* halved together when one fills up */
+};
+
+#ifdef PROFILE
+
+/* The 16 bit read of TCNT1 goes through a register it shares with every
+   other 16 bit register, so an interrupt must not get in between */
+static inline uint16_t profileNow(void)
+{
+    uint16_t now;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        now = TCNT1;
+    }
+    return now;
+}
+
+void profileRecord(uint8_t id, uint16_t start);
+
+struct ProfileScope
+{
+    uint8_t id;
+    uint16_t start;
+};
+
+static inline void profileLeaveScope(const struct ProfileScope *scope)
+{
+    profileRecord(scope->id, scope->start);
+}
+
+#define PROFILE_ENTER(id) const uint16_t profileStart##id = profileNow()
+#define PROFILE_LEAVE(id) profileRecord((id), profileStart##id)
+#define PROFILE_SCOPE(id) \
+    const struct ProfileScope profileScope __attribute__((__cleanup__(profileLeaveScope))) = {(id), profileNow()}
+
+/* Starts Timer1 and clears the stats */
+void initProfiler();
+
+/* Copies the stats of an id, returns 0 when it never ran */
+uint8_t getProfile(uint8_t id, struct ProfileStats *stats);
+
+void resetProfile();
+
+#else
+
+#define PROFILE_ENTER(id)
+#define PROFILE_LEAVE(id)
+#define PROFILE_SCOPE(id)
+#define initProfiler()
+
+#endif
+
+#endif
@@ -0,0 +1,182 @@
+#include <hal.h>
+#include <leds.h>
+
+#include "pwm.h"
+
+#define NO_CHANNEL 0xFF
+
+struct PwmChannel
+{
+    uint8_t output;
+    uint8_t on;
+    uint16_t window;
+    uint16_t minPulse;
+    uint16_t duty;        /* for the next window */
+    uint16_t windowStart;
+    uint16_t switched;    /* time the output last changed, at most PWM_MAX_WINDOW_MS ago */
+    uint16_t edge;        /* time of the next edge */
+    uint8_t next;         /* next channel in edge order */
+};
+
+static struct PwmChannel channels[PWM_CHANNELS];
+static uint8_t firstEdge = NO_CHANNEL;
+static uint16_t now = 0;
+
+// Inserts behind the channels with an edge at the same time
+static void insert(uint8_t id)
+{
+    int16_t due = channels[id].edge - now;
+
+    uint8_t *link = &firstEdge;
+    while (*link != NO_CHANNEL && (int16_t)(channels[*link].edge - now) <= due)
+        link = &channels[*link].next;
+
+    channels[id].next = *link;
+    *link = id;
+}
+
+static void unlink(uint8_t id)
+{
+    uint8_t *link = &firstEdge;
+    while (*link != id)
+        link = &channels[*link].next;
+
+    *link = channels[id].next;
+}
+
+void initPwm()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        firstEdge = NO_CHANNEL;
+
+        for (uint8_t id = 0; id < PWM_CHANNELS; id++)
+        {
+            struct PwmChannel *channel = &channels[id];
+
+            channel->output = id;
+            channel->on = 0;
+            channel->window = PWM_DEFAULT_WINDOW_MS;
+            channel->minPulse = PWM_DEFAULT_MIN_PULSE_MS;
+            channel->duty = 0;
+
+            // Spread the window starts over the first window
+            channel->edge = now + 1 + (uint32_t)PWM_DEFAULT_WINDOW_MS * id / PWM_CHANNELS;
+            channel->windowStart = channel->edge;
+            channel->switched = now - PWM_MAX_WINDOW_MS;
+            insert(id);
+        }
+    }
+}
+
+void setPwmChannel(uint8_t id, uint8_t output, uint16_t windowMs, uint16_t minPulseMs)
+{
+    if (id >= PWM_CHANNELS || windowMs == 0) return;
+
+    if (windowMs > PWM_MAX_WINDOW_MS)
+        windowMs = PWM_MAX_WINDOW_MS;
+    if (minPulseMs > PWM_MAX_WINDOW_MS)
+        minPulseMs = PWM_MAX_WINDOW_MS;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        struct PwmChannel *channel = &channels[id];
+
+        // The old output stops right away
+        if (channel->output != output && channel->on)
+        {
+            setOutput(channel->output, 0);
+            setOutput(output, 1);
+        }
+
+        channel->output = output;
+        channel->window = windowMs;
+        channel->minPulse = minPulseMs;
+    }
+    commitOutputs();
+}
+
+void setPwmDuty(uint8_t id, uint16_t permille)
+{
+    if (id >= PWM_CHANNELS) return;
+    if (permille > PWM_DUTY_MAX) permille = PWM_DUTY_MAX;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        struct PwmChannel *channel = &channels[id];
+        channel->duty = permille;
+
+        // A full on or off the output doesn't follow yet starts a new window as soon
+        // as the minimum pulse allows, so an on/off controller needn't wait for the next one
+        if ((permille == 0 && channel->on) || (permille == PWM_DUTY_MAX && !channel->on))
+        {
+            uint16_t age = now - channel->switched;
+            uint16_t start = age < channel->minPulse ? channel->switched + channel->minPulse : now;
+
+            unlink(id);
+            channel->edge = start;
+            channel->windowStart = start - channel->window;
+            insert(id);
+        }
+    }
+}
+
+uint8_t getPwmOutput(uint8_t id)
+{
+    return id < PWM_CHANNELS ? channels[id].on : 0;
+}
+
+// Handles the edge of a channel and returns when its next edge is
+static uint16_t edge(struct PwmChannel *channel)
+{
+    uint16_t windowEnd = channel->windowStart + channel->window;
+
+    // End of the on time, off until the window is over
+    if (channel->on && channel->edge != windowEnd)
+    {
+        channel->on = 0;
+        return windowEnd;
+    }
+
+    // Start of a window, comes at least every PWM_MAX_WINDOW_MS
+    channel->windowStart = channel->edge;
+    if ((uint16_t)(channel->edge - channel->switched) > PWM_MAX_WINDOW_MS)
+        channel->switched = channel->edge - PWM_MAX_WINDOW_MS;
+
+    windowEnd = channel->windowStart + channel->window;
+
+    uint16_t onTime = (uint32_t)channel->duty * channel->window / PWM_DUTY_MAX;
+    if (onTime < channel->minPulse)
+        onTime = 0;
+    else if (channel->window - onTime < channel->minPulse)
+        onTime = channel->window;
+
+    channel->on = onTime > 0;
+    if (onTime == 0 || onTime == channel->window)
+        return windowEnd;
+    return channel->windowStart + onTime;
+}
+
+void pwmTick()
+{
+    now++;
+
+    if (firstEdge == NO_CHANNEL || (int16_t)(now - channels[firstEdge].edge) < 0)
+        return;
+
+    do
+    {
+        uint8_t id = firstEdge;
+        struct PwmChannel *channel = &channels[id];
+        firstEdge = channel->next;
+
+        uint8_t wasOn = channel->on;
+        channel->edge = edge(channel);
+        if (channel->on != wasOn)
+            channel->switched = now;
+        setOutput(channel->output, channel->on);
+        insert(id);
+    } while ((int16_t)(now - channels[firstEdge].edge) >= 0);
+
+    commitOutputs();
+}
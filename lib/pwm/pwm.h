@@ -0,0 +1,58 @@
+#ifndef PWM_H
+#define PWM_H
+
+#include <stdint.h>
+#include <rooms.h>
+
+/*
+  Time proportioning of the outputs of lib/leds.
+
+  Every channel drives one output with a duty cycle in permille over a
+  window of its own: seconds for a relay, milliseconds for a solid state
+  relay. The output is on for the first duty / 1000 of every window.
+
+  pwmTick() runs every millisecond from the scheduler tick. The channels
+  wait in a list sorted by the time of their next edge, so a tick without an
+  edge costs one compare however many channels there are, and every edge of
+  a tick goes out in one commitOutputs(). The windows of the channels start
+  spread out, so the heaters don't all switch on at the same moment.
+
+  A pulse shorter than minPulseMs is never made: a duty that would give one
+  becomes 0, an off time that short becomes a full window.
+
+  A new duty is used from the next window, except a duty of 0 or PWM_DUTY_MAX
+  the output doesn't follow yet: it starts a new window right away, or once
+  the output has been on or off for minPulseMs. That way an output driven by
+  an on/off controller switches with it instead of up to a window later.
+*/
+
+#ifndef PWM_CHANNELS
+#define PWM_CHANNELS MAX_NUMBER_OF_ROOMS
+#endif
+
+#define PWM_DUTY_MAX 1000
+
+/* Edges are compared as signed 16 bit times, so a window can't be longer */
+#define PWM_MAX_WINDOW_MS 32767
+
+/* A relay with a 10 s window that switches at most once per second */
+#define PWM_DEFAULT_WINDOW_MS 10000
+#define PWM_DEFAULT_MIN_PULSE_MS 1000
+
+/* Channel i drives output i with the default window, every duty 0 */
+void initPwm();
+
+/* A new window and pulse length take effect from the next edge of the channel.
+   A window of 0 is ignored, longer windows and pulses are cut to PWM_MAX_WINDOW_MS. */
+void setPwmChannel(uint8_t channel, uint8_t output, uint16_t windowMs, uint16_t minPulseMs);
+
+/* Used from the start of the next window, 0 and PWM_DUTY_MAX switch sooner ( see above ) */
+void setPwmDuty(uint8_t channel, uint16_t permille);
+
+/* 1 while the output of the channel is on */
+uint8_t getPwmOutput(uint8_t channel);
+
+/* Call every millisecond, from the tick interrupt */
+void pwmTick();
+
+#endif
@@ -0,0 +1,31 @@
+#include "rooms.h"
+
+#define STRINGIFY(x) #x
+#define TO_STRING(x) STRINGIFY(x)
+
+_Static_assert(ROOM_SIZE == 3 * sizeof(temperature_t) + 2 * sizeof(uint8_t), "ROOM_SIZE is out of date");
+_Static_assert(ROOM_STORE_SIZE <= ROOM_STORE_BUDGET, "room store does not fit in ROOM_STORE_BUDGET");
+
+#pragma message "room store: " TO_STRING(MAX_NUMBER_OF_ROOMS) " rooms of " TO_STRING(ROOM_SIZE) " bytes, budget " TO_STRING(ROOM_STORE_BUDGET) " bytes"
+
+temperature_t roomMinTemp[MAX_NUMBER_OF_ROOMS];
+temperature_t roomMaxTemp[MAX_NUMBER_OF_ROOMS];
+temperature_t roomCurrentTemp[MAX_NUMBER_OF_ROOMS];
+uint8_t roomState[MAX_NUMBER_OF_ROOMS];
+uint8_t roomSensorChannel[MAX_NUMBER_OF_ROOMS];
+uint8_t roomCount = 0;
+
+int8_t addRoom(temperature_t min, temperature_t max)
+{
+    if (roomCount >= MAX_NUMBER_OF_ROOMS) return -1;
+
+    uint8_t room = roomCount;
+    roomMinTemp[room] = min;
+    roomMaxTemp[room] = max;
+    roomCurrentTemp[room] = 0;
+    roomState[room] = 0;
+    roomSensorChannel[room] = ROOM_DEFAULT_SENSOR;
+
+    roomCount++;
+    return room;
+}
@@ -0,0 +1,48 @@
+#ifndef ROOMS_H
+#define ROOMS_H
+
+#include <sensor.h>
+
+/* Up to 8 rooms, the heating bits of a telemetry sample are one byte */
+#ifndef MAX_NUMBER_OF_ROOMS
+#define MAX_NUMBER_OF_ROOMS 2
+#endif
+
+/* Highest setpoint a room accepts, 400 is 40.0 degrees */
+#define MAX_ROOM_TEMPERATURE 400
+
+/* ADC channel of the sensor of a new room, the board has its sensor on ADC4 */
+#ifndef ROOM_DEFAULT_SENSOR
+#define ROOM_DEFAULT_SENSOR 4
+#endif
+
+/* Bits in roomState */
+#define ROOM_HEATING 0x01
+
+/* Bytes one room takes in the store: min, max and current temperature plus the state
+   and the sensor channel */
+#define ROOM_SIZE 8
+#define ROOM_STORE_SIZE (MAX_NUMBER_OF_ROOMS * ROOM_SIZE + 1)
+
+/* The build fails when the room store grows past this many bytes of SRAM,
+   the default fits 8 rooms */
+#ifndef ROOM_STORE_BUDGET
+#define ROOM_STORE_BUDGET (8 * ROOM_SIZE + 1)
+#endif
+
+/*
+  Statically allocated room store, one array per field so a loop over the
+  rooms only touches the field it needs. Room i lives at index i of every
+  array, only the first roomCount entries are in use.
+*/
+extern temperature_t roomMinTemp[MAX_NUMBER_OF_ROOMS];
+extern temperature_t roomMaxTemp[MAX_NUMBER_OF_ROOMS];
+extern temperature_t roomCurrentTemp[MAX_NUMBER_OF_ROOMS];
+extern uint8_t roomState[MAX_NUMBER_OF_ROOMS];
+extern uint8_t roomSensorChannel[MAX_NUMBER_OF_ROOMS];
+extern uint8_t roomCount;
+
+/* Adds a room with its sensor on ROOM_DEFAULT_SENSOR, returns its index or -1 when the store is full */
+int8_t addRoom(temperature_t min, temperature_t max);
+
+#endif
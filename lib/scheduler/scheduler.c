@@ -0,0 +1,225 @@
+#include <hal.h>
+#include <bench.h>
+#include <sram.h>
+#include <profile.h>
+
+#include "scheduler.h"
+
+#define TIMER0_PRESCALER 64
+#define TIMER0_TOP (F_CPU / TIMER0_PRESCALER / SCHEDULER_TICK_HZ - 1)
+#define MICROS_PER_COUNT (1000000UL * TIMER0_PRESCALER / F_CPU)
+
+#if TIMER0_TOP > 255
+#error "The 1 ms tick does not fit in Timer0 at this F_CPU"
+#endif
+
+#define NO_TASK 0xFF
+
+struct Task
+{
+    TaskFunction function;
+    uint16_t period;
+    uint16_t deadline; /* low 16 bits of millis() */
+    uint8_t next;      /* next task in deadline order */
+};
+
+static volatile uint32_t ticks = 0;
+static void (*volatile tickHook)(void) = 0;
+
+/* Used slots form a list sorted by deadline, a free slot has no function */
+static struct Task tasks[SCHEDULER_MAX_TASKS];
+static struct TaskStats stats[SCHEDULER_MAX_TASKS];
+static uint8_t firstTask = NO_TASK;
+
+// The task runTasks() is in, its slot stays taken until it returns
+static uint8_t runningTask = NO_TASK;
+static uint8_t runningRemoved = 0;
+
+void initScheduler()
+{
+    // CTC mode, TOP is OCR0A
+    TCCR0A = _BV(WGM01);
+    OCR0A = TIMER0_TOP;
+    TCNT0 = 0;
+
+    // Prescaler 64
+    TCCR0B = _BV(CS01) | _BV(CS00);
+
+    TIMSK0 = _BV(OCIE0A);
+}
+
+ISR(TIMER0_COMPA_vect)
+{
+    PROFILE_SCOPE(PROFILE_ISR_TIMER0);
+    BENCH_BEGIN(BENCH_TIMER0_ISR);
+    SRAM_ISR_PROBE(SRAM_ISR_TIMER0);
+
+    ticks++;
+    void (*hook)(void) = tickHook;
+    if (hook)
+        hook();
+
+    BENCH_END(BENCH_TIMER0_ISR);
+}
+
+uint32_t millis()
+{
+    uint32_t now;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        now = ticks;
+    }
+    return now;
+}
+
+uint32_t micros()
+{
+    uint32_t now;
+    uint8_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        now = ticks;
+        count = TCNT0;
+
+        // The counter wrapped but the interrupt did not run yet
+        if ((TIFR0 & _BV(OCF0A)) && count < TIMER0_TOP)
+            now++;
+    }
+    return now * 1000 + count * MICROS_PER_COUNT;
+}
+
+static uint16_t millis16()
+{
+    return (uint16_t)millis();
+}
+
+void setTickHook(void (*hook)(void))
+{
+    tickHook = hook;
+}
+
+static void unlink(uint8_t id)
+{
+    uint8_t *link = &firstTask;
+    while (*link != NO_TASK)
+    {
+        if (*link == id)
+        {
+            *link = tasks[id].next;
+            return;
+        }
+        link = &tasks[*link].next;
+    }
+}
+
+// Inserts behind the tasks with the same deadline, so equal tasks take turns
+static void insert(uint8_t id)
+{
+    uint16_t now = millis16();
+    int16_t due = tasks[id].deadline - now;
+
+    uint8_t *link = &firstTask;
+    while (*link != NO_TASK && (int16_t)(tasks[*link].deadline - now) <= due)
+        link = &tasks[*link].next;
+
+    tasks[id].next = *link;
+    *link = id;
+}
+
+int8_t addTask(TaskFunction function, uint16_t periodMs, uint16_t delayMs)
+{
+    for (uint8_t id = 0; id < SCHEDULER_MAX_TASKS; id++)
+    {
+        if (tasks[id].function)
+            continue;
+
+        tasks[id].function = function;
+        tasks[id].period = periodMs;
+        tasks[id].deadline = millis16() + delayMs;
+        stats[id].runs = 0;
+        stats[id].maxRunMicros = 0;
+        stats[id].overruns = 0;
+        insert(id);
+        return id;
+    }
+    return SCHEDULER_NO_TASK;
+}
+
+void removeTask(int8_t id)
+{
+    if (id < 0 || id >= SCHEDULER_MAX_TASKS || !tasks[id].function)
+        return;
+
+    // A running task is not linked, runTasks() frees the slot when it returns
+    if (id == runningTask)
+    {
+        runningRemoved = 1;
+        return;
+    }
+
+    unlink(id);
+    tasks[id].function = 0;
+}
+
+uint8_t runTasks()
+{
+    uint8_t ran = 0;
+
+    while (firstTask != NO_TASK)
+    {
+        uint8_t id = firstTask;
+        struct Task *task = &tasks[id];
+
+        if ((int16_t)(millis16() - task->deadline) < 0)
+            break;
+
+        firstTask = task->next;
+
+        runningTask = id;
+        runningRemoved = 0;
+        uint32_t start = micros();
+        task->function();
+        uint32_t runTime = micros() - start;
+        runningTask = NO_TASK;
+
+        stats[id].runs++;
+        if (runTime > stats[id].maxRunMicros)
+            stats[id].maxRunMicros = runTime > 0xFFFF ? 0xFFFF : runTime;
+        ran++;
+
+        // A one shot task is done, so is a task that removed itself
+        if (!task->period || runningRemoved)
+        {
+            task->function = 0;
+            continue;
+        }
+
+        // Skip the periods that were missed instead of running the task back to back
+        task->deadline += task->period;
+        if ((int16_t)(millis16() - task->deadline) >= 0)
+        {
+            stats[id].overruns++;
+            task->deadline = millis16() + task->period;
+        }
+        insert(id);
+    }
+    return ran;
+}
+
+uint16_t nextTaskDue()
+{
+    if (firstTask == NO_TASK)
+        return 0xFFFF;
+
+    int16_t due = tasks[firstTask].deadline - millis16();
+    return due > 0 ? due : 0;
+}
+
+uint8_t getTaskStats(int8_t id, struct TaskStats *taskStats)
+{
+    if (id < 0 || id >= SCHEDULER_MAX_TASKS || !tasks[id].function)
+        return 0;
+
+    *taskStats = stats[id];
+    return 1;
+}
@@ -0,0 +1,60 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+/*
+  Cooperative scheduler on a 1 ms system tick.
+
+  Timer0 runs in CTC mode: 16 MHz / 64 / 250 is exactly 1 kHz. Tasks are
+  plain functions that run to completion from runTasks() in the main loop,
+  so they never interrupt each other. Work that has to happen inside the
+  tick interrupt goes in the tick hook instead.
+*/
+
+#define SCHEDULER_TICK_HZ 1000
+
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 8
+#endif
+
+#define SCHEDULER_NO_TASK -1
+
+typedef void (*TaskFunction)(void);
+
+struct TaskStats
+{
+    uint16_t runs;
+    uint16_t maxRunMicros; /* longest single run */
+    uint16_t overruns;     /* runs that started a whole period or more too late */
+};
+
+/* Starts the 1 ms tick, enable interrupts afterwards */
+void initScheduler();
+
+/* Time since initScheduler(), millis() wraps after 49 days, micros() after 71 minutes */
+uint32_t millis();
+uint32_t micros();
+
+/* Called from the tick interrupt every millisecond, keep it short. 0 disables it. */
+void setTickHook(void (*hook)(void));
+
+/* Runs function after delayMs and then every periodMs, a period of 0 runs it once.
+   Periods and delays go up to 32767 ms. Returns the task id or SCHEDULER_NO_TASK
+   when all SCHEDULER_MAX_TASKS slots are taken. Only call it from the main loop. */
+int8_t addTask(TaskFunction function, uint16_t periodMs, uint16_t delayMs);
+
+/* A task may remove itself, its slot is only free for addTask() once it returned */
+void removeTask(int8_t id);
+
+/* Runs every task that is due, returns how many ran */
+uint8_t runTasks();
+
+/* Milliseconds until the next task is due, 0 when one is due already,
+   0xFFFF when there are no tasks */
+uint16_t nextTaskDue();
+
+/* Returns 0 when id is not a task */
+uint8_t getTaskStats(int8_t id, struct TaskStats *stats);
+
+#endif
@@ -1,17 +1,176 @@
-#include <avr/io.h>
-#include <util/delay.h>
+#include <hal.h>
+
+#include <events.h>
+#include <sram.h>
+#include <profile.h>
+
+#include "sensor.h"
+
+#if ADC_OVERSAMPLE_BITS > 3
+#error "ADC_OVERSAMPLE_BITS larger than 3 overflows the 16 bit accumulator"
+#endif
+
+static uint16_t accumulator = 0;
+static uint8_t sampleCount = 0;
+
+// Channels of the running scan and the one being sampled
+static uint8_t scanChannels = 0;
+static uint8_t scanChannel = 0;
+
+static volatile uint16_t results[ADC_CHANNELS];
+
+// Calibration and filter state per channel, the filter keeps
+// SENSOR_FILTER_SHIFT extra bits so small steps don't get lost
+static int16_t gainQ8[ADC_CHANNELS];
+static temperature_t offset[ADC_CHANNELS];
+static int32_t filtered[ADC_CHANNELS];
+static uint8_t filterStarted = 0;
 
 void initADC()
 {
     ADMUX = ( 1 << REFS0 ) | ( 1 << MUX2 );
 
+    for (uint8_t i = 0; i < ADC_CHANNELS; i++)
+        gainQ8[i] = SENSOR_GAIN_Q8;
+
     ADCSRA = ( 1 << ADEN ) | ( 1 << ADPS2 ) | ( 1 << ADPS1 ) | ( 1 << ADPS0 ); 
+
+#ifdef ADC_TRIGGER_TIMER0
+    // Auto trigger source: Timer0 compare match A, the 1 ms scheduler tick
+    ADCSRB = ( 1 << ADTS1 ) | ( 1 << ADTS0 );
+#endif
+}
+
+static void selectChannel(uint8_t next)
+{
+    scanChannel = next;
+    ADMUX = ( ADMUX & 0xF0 ) | next;
+    accumulator = 0;
+    sampleCount = 0;
+}
+
+uint8_t startADCScan(uint8_t channels)
+{
+    if (adcSampling())
+        return 0;
+    if (!channels)
+        return 1;
+
+    scanChannels = channels;
+
+    uint8_t first = 0;
+    while (!(channels & (1 << first)))
+        first++;
+    selectChannel(first);
+
+    // Writing a one to ADIF clears a flag left over from an earlier run
+#ifdef ADC_TRIGGER_TIMER0
+    ADCSRA |= ( 1 << ADIF ) | ( 1 << ADIE ) | ( 1 << ADATE );
+#else
+    ADCSRA |= ( 1 << ADIF ) | ( 1 << ADIE ) | ( 1 << ADSC );
+#endif
+    return 1;
+}
+
+ISR(ADC_vect)
+{
+    PROFILE_SCOPE(PROFILE_ISR_ADC);
+    SRAM_ISR_PROBE(SRAM_ISR_ADC);
+
+    uint16_t sample = ADC;
+
+    // The first conversions after a channel switch are thrown away
+    if (sampleCount++ >= ADC_SETTLE_SAMPLES)
+        accumulator += sample;
+
+    if (sampleCount < ADC_SETTLE_SAMPLES + ADC_SAMPLES)
+    {
+#ifndef ADC_TRIGGER_TIMER0
+        ADCSRA |= ( 1 << ADSC );
+#endif
+        return;
+    }
+
+    // Decimate: keep ADC_OVERSAMPLE_BITS of the extra bits the sum gained
+    results[scanChannel] = accumulator >> ADC_OVERSAMPLE_BITS;
+
+    // Straight on with the next channel of the scan, the new MUX setting is
+    // used from the next conversion on
+    uint8_t next = scanChannel + 1;
+    while (next < ADC_CHANNELS && !(scanChannels & (1 << next)))
+        next++;
+
+    if (next < ADC_CHANNELS)
+    {
+        selectChannel(next);
+#ifndef ADC_TRIGGER_TIMER0
+        ADCSRA |= ( 1 << ADSC );
+#endif
+        return;
+    }
+
+    ADCSRA &= ~(( 1 << ADIE ) | ( 1 << ADATE ));
+    pushEvent(EVENT_SENSOR_READY, scanChannels);
+}
+
+uint8_t adcSampling()
+{
+    return bit_is_set(ADCSRA, ADIE) != 0;
+}
+
+uint16_t getADCResult(uint8_t channel)
+{
+    uint16_t value;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        value = results[channel & (ADC_CHANNELS - 1)];
+    }
+    return value;
+}
+
+void setChannelCalibration(uint8_t channel, int16_t gain, temperature_t channelOffset)
+{
+    if (channel >= ADC_CHANNELS)
+        return;
+
+    gainQ8[channel] = gain;
+    offset[channel] = channelOffset;
+}
+
+void updateTemperatures(uint8_t channels)
+{
+    for (uint8_t i = 0; i < ADC_CHANNELS; i++)
+    {
+        if (!(channels & (1 << i)))
+            continue;
+
+        // The Q8.8 gain and the oversampling bits are both shifted out at once
+        int32_t temperature = ((int32_t) getADCResult(i) * gainQ8[i]) >> (8 + ADC_OVERSAMPLE_BITS);
+        temperature += offset[i];
+
+        // Exponential moving average, the first value fills the filter
+        if (!(filterStarted & (1 << i)))
+        {
+            filtered[i] = temperature << SENSOR_FILTER_SHIFT;
+            filterStarted |= 1 << i;
+        }
+        else
+            filtered[i] += temperature - (filtered[i] >> SENSOR_FILTER_SHIFT);
+    }
+}
+
+temperature_t getChannelTemperature(uint8_t channel)
+{
+    if (channel >= ADC_CHANNELS)
+        return 0;
+
+    return filtered[channel] >> SENSOR_FILTER_SHIFT;
 }
 
 uint16_t readADC(uint8_t channel)
 {
     if (channel > 7)
-        return;
+        return 0;
 
     ADMUX = ( ADMUX & 0xF0 ) | channel;
 
@@ -19,8 +178,9 @@ uint16_t readADC(uint8_t channel)
 
     while ( ADCSRA & ( 1 << ADSC ));
 
+    // ADCL has to be read first, it locks the result until ADCH is read
     uint16_t adc_value = ADCL;
-    adc_value |= ( ADCH << 0 );
+    adc_value |= ( ADCH << 8 );
 
     return adc_value;
-}
\ No newline at end of file
+}
@@ -1,10 +1,73 @@
+#include <stdint.h>
 #include <stdio.h>
 
 #ifndef SENSOR_H
 #define SENSOR_H
 
+/* Every extra bit of resolution costs four times as many samples,
+   2 bits gives 16 samples per result and a 12 bit value */
+#ifndef ADC_OVERSAMPLE_BITS
+#define ADC_OVERSAMPLE_BITS 2
+#endif
+
+#define ADC_SAMPLES (1 << (2 * ADC_OVERSAMPLE_BITS))
+#define ADC_RESULT_BITS (10 + ADC_OVERSAMPLE_BITS)
+
+/* Temperatures are fixed point numbers in tenths of a degree celsius,
+   215 means 21.5 degrees */
+typedef int16_t temperature_t;
+
+#define TEMPERATURE_SCALE 10
+
+/* Default sensor calibration: tenths of a degree per 10 bit ADC step, as a Q8.8 number.
+   1080 / 256 = 4.22 */
+#ifndef SENSOR_GAIN_Q8
+#define SENSOR_GAIN_Q8 1080
+#endif
+
+/* Conversions thrown away after switching channels, while the sample and
+   hold capacitor settles on the new input */
+#ifndef ADC_SETTLE_SAMPLES
+#define ADC_SETTLE_SAMPLES 1
+#endif
+
+/* Filtered temperature: every new value counts for 1 / 2^SENSOR_FILTER_SHIFT */
+#ifndef SENSOR_FILTER_SHIFT
+#define SENSOR_FILTER_SHIFT 2
+#endif
+
+#define ADC_CHANNELS 8
+
+/* Build with -D ADC_TRIGGER_TIMER0 to start every conversion on the 1 ms
+   scheduler tick instead of right after the previous one. */
+
 void initADC();
 
+/* Scans the channels set in the channels bit mask one after the other in the
+   background, ADC_SAMPLES conversions each. An EVENT_SENSOR_READY with the
+   mask as data is queued when the last one is done. Returns 0 when a scan is
+   still running. */
+uint8_t startADCScan(uint8_t channels);
+
+/* 1 while a scan is going on */
+uint8_t adcSampling();
+
+/* Oversampled result of a channel from the last scan */
+uint16_t getADCResult(uint8_t channel);
+
+/* Converts the results of the channels in the mask to temperatures with the
+   calibration of each channel and runs them through the filter, call it on
+   EVENT_SENSOR_READY */
+void updateTemperatures(uint8_t channels);
+
+/* Filtered temperature of a channel */
+temperature_t getChannelTemperature(uint8_t channel);
+
+/* Temperature = result * gainQ8 / 256 + offset, for an oversampled result
+   scaled back to 10 bits. The default is SENSOR_GAIN_Q8 and no offset. */
+void setChannelCalibration(uint8_t channel, int16_t gainQ8, temperature_t offset);
+
+/* Single blocking conversion, don't use it while a sampling run is going on */
 uint16_t readADC(uint8_t channel);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,111 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "sram.h"
+
+uint16_t sramIsrStack[SRAM_ISR_COUNT];
+
+#ifdef HAL_NATIVE
+
+// No linker on a pc, the heap starts at a fixed place of halRam and stays empty
+#define HEAP_START 0x0400
+#define heapEnd() HEAP_START
+#define ramByte(address) halRam[address]
+
+void paintStack(void)
+{
+    memset(&halRam[HEAP_START], SRAM_PAINT, RAMEND + 1 - HEAP_START);
+}
+
+static void walkFreeList(struct SramStats *stats)
+{
+}
+
+#else
+
+// From the linker script and the malloc() of avr-libc
+extern uint8_t __heap_start;
+extern char *__brkval;
+
+struct __freelist
+{
+    size_t sz;
+    struct __freelist *nx;
+};
+extern struct __freelist *__flp;
+
+#define HEAP_START ((uint16_t)(uintptr_t)&__heap_start)
+#define heapEnd() (__brkval ? (uint16_t)(uintptr_t)__brkval : HEAP_START)
+#define ramByte(address) (*(volatile uint8_t *)(uintptr_t)(address))
+
+// Nothing is set up yet in .init1, not even r1 or the stack pointer, so it is
+// all registers. Paints from the end of .bss up to and including RAMEND.
+void paintStack(void) __attribute__((naked, used, section(".init1")));
+
+void paintStack(void)
+{
+    __asm__ volatile(
+        "    ldi r30, lo8(__heap_start)\n"
+        "    ldi r31, hi8(__heap_start)\n"
+        "    ldi r24, %0\n"
+        "    ldi r25, hi8(%1)\n"
+        "    rjmp 2f\n"
+        "1:  st Z+, r24\n"
+        "2:  cpi r30, lo8(%1)\n"
+        "    cpc r31, r25\n"
+        "    brlo 1b\n"
+        "    breq 1b\n"
+        :
+        : "M"(SRAM_PAINT), "i"(RAMEND));
+}
+
+static void walkFreeList(struct SramStats *stats)
+{
+    for (struct __freelist *block = __flp; block; block = block->nx)
+    {
+        // A block also frees the size field in front of it
+        uint16_t size = block->sz + sizeof(size_t);
+
+        stats->heapFree += size;
+        stats->heapFreeBlocks++;
+        if (size > stats->heapLargest)
+            stats->heapLargest = size;
+    }
+}
+
+#endif
+
+void getSramStats(struct SramStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    // Only the main loop allocates, interrupts stay on during the scan
+    uint16_t end = heapEnd();
+
+    stats->data = HEAP_START - RAMSTART;
+    stats->heap = end - HEAP_START;
+    walkFreeList(stats);
+    stats->stack = RAMEND - SP;
+
+    // The paint is gone from the deepest point of the stack up
+    uint16_t address = end;
+    while (address <= RAMEND && ramByte(address) == SRAM_PAINT)
+        address++;
+
+    stats->unused = address - end;
+    stats->stackMax = RAMEND + 1 - address;
+}
+
+uint16_t getIsrStack(uint8_t isr)
+{
+    uint16_t depth = 0;
+
+    if (isr < SRAM_ISR_COUNT)
+    {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            depth = sramIsrStack[isr];
+        }
+    }
+    return depth;
+}
@@ -0,0 +1,69 @@
+#ifndef SRAM_H
+#define SRAM_H
+
+#include <stdint.h>
+#include <hal.h>
+
+/*
+  How much of the 2 KB of SRAM is in use.
+
+  From low to high the SRAM holds .data and .bss, the heap and the stack,
+  which grows down towards the heap. Before main() runs, paintStack() fills
+  everything between the end of .bss and the top of the stack with
+  SRAM_PAINT. The deepest the stack has ever been is where the paint stops,
+  getSramStats() looks for it from the end of the heap up. A stack byte that
+  happens to hold SRAM_PAINT makes the mark a little too low.
+
+  The heap is only used by stdio and malloc(), the firmware itself allocates
+  nothing. Its stats come from the allocator of avr-libc: __brkval is the
+  end of the heap and __flp the list of freed blocks in it.
+
+  Every interrupt handler starts with SRAM_ISR_PROBE(), which keeps the
+  deepest stack seen at its entry: the stack of the code it interrupted plus
+  the registers it saved. That is two reads of SP and a compare, about 10
+  cycles.
+*/
+
+#define SRAM_PAINT 0xC5
+
+/* Interrupt handlers with a probe */
+#define SRAM_ISR_TIMER0 0
+#define SRAM_ISR_TIMER2 1
+#define SRAM_ISR_ADC 2
+#define SRAM_ISR_USART_TX 3
+#define SRAM_ISR_USART_RX 4
+#define SRAM_ISR_EEPROM 5
+#define SRAM_ISR_COUNT 6
+
+/* Sizes in bytes */
+struct SramStats
+{
+    uint16_t data;           /* .data and .bss */
+    uint16_t heap;           /* taken by the heap, free blocks included */
+    uint16_t heapFree;       /* in freed blocks */
+    uint16_t heapFreeBlocks; /* number of freed blocks, the fragmentation */
+    uint16_t heapLargest;    /* largest freed block */
+    uint16_t stack;          /* right now */
+    uint16_t stackMax;       /* deepest since the start */
+    uint16_t unused;         /* never touched, between the heap and the deepest stack */
+};
+
+extern uint16_t sramIsrStack[SRAM_ISR_COUNT];
+
+#define SRAM_ISR_PROBE(isr)                 \
+    do {                                    \
+        uint16_t depth = RAMEND - SP;       \
+        if (depth > sramIsrStack[isr])      \
+            sramIsrStack[isr] = depth;      \
+    } while (0)
+
+/* Runs from .init1 on the board, a native test calls it itself */
+void paintStack(void);
+
+/* Looks for the end of the paint, reads up to all of the free SRAM */
+void getSramStats(struct SramStats *stats);
+
+/* Deepest stack at the entry of an interrupt handler, SRAM_ISR_* */
+uint16_t getIsrStack(uint8_t isr);
+
+#endif
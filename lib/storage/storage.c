@@ -0,0 +1,176 @@
+#include <stddef.h>
+#include <string.h>
+
+#include <hal.h>
+#include <rooms.h>
+#include <scheduler.h>
+#include <control.h>
+#include <sram.h>
+#include <profile.h>
+
+#include "storage.h"
+
+struct SettingsRecord
+{
+    uint8_t version;
+    uint8_t roomCount;
+    uint16_t sequence;
+    temperature_t minTemp[MAX_NUMBER_OF_ROOMS];
+    temperature_t maxTemp[MAX_NUMBER_OF_ROOMS];
+    uint8_t sensorChannel[MAX_NUMBER_OF_ROOMS];
+    uint8_t controlMode[MAX_NUMBER_OF_ROOMS];
+    int16_t kp[MAX_NUMBER_OF_ROOMS];
+    int16_t ki[MAX_NUMBER_OF_ROOMS];
+    int16_t kd[MAX_NUMBER_OF_ROOMS];
+    uint8_t sampleTicks[MAX_NUMBER_OF_ROOMS];
+    uint16_t minOnSeconds[MAX_NUMBER_OF_ROOMS];
+    uint16_t minOffSeconds[MAX_NUMBER_OF_ROOMS];
+    uint16_t crc; /* of everything above, has to stay the last field */
+};
+
+#define RECORD_SIZE sizeof(struct SettingsRecord)
+#define SLOT_COUNT (STORAGE_SIZE / RECORD_SIZE)
+
+_Static_assert(SLOT_COUNT >= 2 && SLOT_COUNT <= 255, "The log needs 2 to 255 slots");
+_Static_assert(STORAGE_START + STORAGE_SIZE <= E2END + 1, "The log has to fit in the EEPROM");
+
+// Slot and sequence number of the next save
+static uint8_t nextSlot = 0;
+static uint16_t nextSequence = 0;
+
+static int8_t saveTask = SCHEDULER_NO_TASK;
+static uint16_t writes = 0;
+
+// Record being written by the EE_READY interrupt
+static struct SettingsRecord pending;
+static uint16_t pendingAddress;
+static volatile uint8_t pendingIndex = RECORD_SIZE;
+
+static uint16_t recordCrc(const struct SettingsRecord *record)
+{
+    const uint8_t *bytes = (const uint8_t *)record;
+    uint16_t crc = 0xFFFF;
+
+    for (uint8_t i = 0; i < offsetof(struct SettingsRecord, crc); i++)
+        crc = _crc_ccitt_update(crc, bytes[i]);
+    return crc;
+}
+
+static uint16_t slotAddress(uint8_t slot)
+{
+    return STORAGE_START + slot * RECORD_SIZE;
+}
+
+uint8_t loadSettings()
+{
+    struct SettingsRecord record;
+    struct SettingsRecord newest;
+    uint8_t found = 0;
+
+    for (uint8_t slot = 0; slot < SLOT_COUNT; slot++)
+    {
+        eeprom_read_block(&record, (const void *)(uintptr_t)slotAddress(slot), RECORD_SIZE);
+
+        if (record.version != STORAGE_VERSION || record.roomCount > MAX_NUMBER_OF_ROOMS)
+            continue;
+        if (record.crc != recordCrc(&record))
+            continue;
+
+        // Sequence numbers wrap around, newer means less than half the range ahead
+        if (found && (int16_t)(record.sequence - newest.sequence) <= 0)
+            continue;
+
+        newest = record;
+        nextSlot = slot + 1 == SLOT_COUNT ? 0 : slot + 1;
+        found = 1;
+    }
+
+    if (!found)
+        return 0;
+
+    nextSequence = newest.sequence + 1;
+    for (uint8_t i = 0; i < newest.roomCount; i++)
+    {
+        int8_t room = addRoom(newest.minTemp[i], newest.maxTemp[i]);
+        if (room < 0)
+            continue;
+
+        if (newest.sensorChannel[i] < ADC_CHANNELS)
+            roomSensorChannel[room] = newest.sensorChannel[i];
+        if (newest.controlMode[i] == CONTROL_PID)
+            setControlMode(room, CONTROL_PID);
+        setControlGains(room, newest.kp[i], newest.ki[i], newest.kd[i]);
+        setControlTiming(room, newest.sampleTicks[i], newest.minOnSeconds[i], newest.minOffSeconds[i]);
+    }
+    return 1;
+}
+
+ISR(EE_READY_vect)
+{
+    PROFILE_SCOPE(PROFILE_ISR_EEPROM);
+    SRAM_ISR_PROBE(SRAM_ISR_EEPROM);
+
+    while (pendingIndex < RECORD_SIZE)
+    {
+        uint16_t address = pendingAddress + pendingIndex;
+        uint8_t data = ((const uint8_t *)&pending)[pendingIndex++];
+
+        // Skipping equal bytes saves an erase and write cycle of 3.4 ms
+        if (eeprom_read_byte((const uint8_t *)(uintptr_t)address) == data)
+            continue;
+
+        EEAR = address;
+        EEDR = data;
+        EECR |= _BV(EEMPE);
+        EECR |= _BV(EEPE);
+        return;
+    }
+
+    // Done, the interrupt would keep firing while the EEPROM is ready
+    EECR &= ~_BV(EERIE);
+}
+
+static void saveSettings()
+{
+    // Still writing the previous record, try again a bit later
+    if (pendingIndex < RECORD_SIZE)
+    {
+        saveTask = addTask(saveSettings, 0, 10);
+        return;
+    }
+    saveTask = SCHEDULER_NO_TASK;
+
+    memset(&pending, 0, RECORD_SIZE);
+    pending.version = STORAGE_VERSION;
+    pending.roomCount = roomCount;
+    pending.sequence = nextSequence++;
+    memcpy(pending.minTemp, roomMinTemp, sizeof(pending.minTemp));
+    memcpy(pending.maxTemp, roomMaxTemp, sizeof(pending.maxTemp));
+    memcpy(pending.sensorChannel, roomSensorChannel, sizeof(pending.sensorChannel));
+    for (uint8_t i = 0; i < roomCount; i++)
+    {
+        pending.controlMode[i] = getControlMode(i);
+        getControlGains(i, &pending.kp[i], &pending.ki[i], &pending.kd[i]);
+        getControlTiming(i, &pending.sampleTicks[i], &pending.minOnSeconds[i], &pending.minOffSeconds[i]);
+    }
+    pending.crc = recordCrc(&pending);
+
+    pendingAddress = slotAddress(nextSlot);
+    nextSlot = nextSlot + 1 == SLOT_COUNT ? 0 : nextSlot + 1;
+    writes++;
+
+    // The interrupt fires as soon as the EEPROM is ready and writes the bytes in order
+    pendingIndex = 0;
+    EECR |= _BV(EERIE);
+}
+
+void settingsChanged()
+{
+    removeTask(saveTask);
+    saveTask = addTask(saveSettings, 0, STORAGE_SAVE_DELAY_MS);
+}
+
+uint16_t getStorageWrites()
+{
+    return writes;
+}
@@ -0,0 +1,48 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <stdint.h>
+
+/*
+  Keeps the rooms, their setpoints, sensor channels and control settings in EEPROM.
+
+  Every save writes a complete record to the next slot of a circular log,
+  so the writes are spread over STORAGE_SIZE bytes instead of wearing out
+  the same cells. A record has a version, a sequence number and a CRC-16,
+  at boot the valid record with the highest sequence number wins. The CRC
+  is written last, so a record cut short by a reset is simply not valid
+  and the one before it is used.
+
+  Saves are deferred: settingsChanged() restarts a timer and the record is
+  only written STORAGE_SAVE_DELAY_MS after the last change. The bytes are
+  written one at a time from the EE_READY interrupt, bytes that already
+  hold the right value are skipped.
+*/
+
+/* Part of the EEPROM used for the log */
+#ifndef STORAGE_START
+#define STORAGE_START 0
+#endif
+
+#ifndef STORAGE_SIZE
+#define STORAGE_SIZE 512
+#endif
+
+#ifndef STORAGE_SAVE_DELAY_MS
+#define STORAGE_SAVE_DELAY_MS 2000
+#endif
+
+/* Raise it when the record changes, older records are ignored then */
+#define STORAGE_VERSION 4
+
+/* Adds the saved rooms to the room store and sets their control mode, gains
+   and times, call after initControl(). Returns 0 when there is no valid record. */
+uint8_t loadSettings();
+
+/* Call after every change of the rooms, the save follows once the changes stop */
+void settingsChanged();
+
+/* Records written since the start */
+uint16_t getStorageWrites();
+
+#endif
@@ -0,0 +1,188 @@
+#include <string.h>
+
+#include <hal.h>
+#include <rooms.h>
+#include <scheduler.h>
+#include <usart.h>
+
+#include "telemetry.h"
+
+#if TELEMETRY_BATCH > TELEMETRY_MAX_BATCH || TELEMETRY_BATCH < 1
+#error "TELEMETRY_BATCH must be 1 to TELEMETRY_MAX_BATCH"
+#endif
+
+#define HEADER_SIZE 6
+#define SETPOINT_SIZE 4
+#define SAMPLE_SIZE(rooms) (1 + 2 * (rooms))
+#define CRC_SIZE 2
+
+_Static_assert(TELEMETRY_MAX_BATCH >= 1, "Not even one sample fits in the transmit buffer, raise USART_TX_BUFFER_SIZE");
+
+#define FRAME_SIZE (HEADER_SIZE + MAX_NUMBER_OF_ROOMS * SETPOINT_SIZE + \
+                    TELEMETRY_MAX_BATCH * SAMPLE_SIZE(MAX_NUMBER_OF_ROOMS) + CRC_SIZE)
+
+// COBS overhead plus the 0x00 in front and behind
+#define ENCODED_SIZE (FRAME_SIZE + FRAME_SIZE / 254 + 1 + 2)
+
+_Static_assert(MAX_NUMBER_OF_ROOMS <= 8, "The heating bits of one sample fit in one byte");
+_Static_assert(ENCODED_SIZE < USART_TX_BUFFER_SIZE,
+               "A frame goes in the transmit buffer in one go, TELEMETRY_FRAME_OVERHEAD is out of date");
+
+// Samples of the batch being collected
+static uint8_t samples[TELEMETRY_MAX_BATCH * SAMPLE_SIZE(MAX_NUMBER_OF_ROOMS)];
+static uint8_t sampleCount = 0;
+static uint8_t sampleRooms = 0;
+
+static uint8_t batchSize = TELEMETRY_BATCH;
+static uint16_t samplePeriod = TELEMETRY_SAMPLE_MS;
+static int8_t sampleTask = SCHEDULER_NO_TASK;
+
+// Frame waiting for room in the transmit buffer
+static uint8_t encoded[ENCODED_SIZE];
+static uint8_t encodedLength = 0;
+static uint8_t sequence = 0;
+
+static uint16_t dropped = 0;
+
+uint16_t cobsEncode(const uint8_t *data, uint16_t length, uint8_t *out)
+{
+    uint16_t codeIndex = 0;
+    uint16_t index = 1;
+    uint8_t code = 1;
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        if (data[i])
+        {
+            out[index++] = data[i];
+            code++;
+        }
+
+        // A zero ends a block, so does a block of 254 data bytes
+        if (!data[i] || code == 0xFF)
+        {
+            out[codeIndex] = code;
+            codeIndex = index++;
+            code = 1;
+        }
+    }
+    out[codeIndex] = code;
+    return index;
+}
+
+static void put16(uint8_t *buffer, uint16_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+}
+
+// The whole frame goes in at once, so text sent in between can't split it
+static void sendFrame()
+{
+    if (getUSARTTxFree() < encodedLength)
+    {
+        // Without a free task slot the frame is dropped, or no frame would ever go out again
+        if (addTask(sendFrame, 0, 5) == SCHEDULER_NO_TASK)
+        {
+            encodedLength = 0;
+            dropped++;
+        }
+        return;
+    }
+
+    transmitBuffer(encoded, encodedLength);
+    encodedLength = 0;
+}
+
+static void buildFrame()
+{
+    uint8_t frame[FRAME_SIZE];
+    uint8_t length = 0;
+
+    frame[length++] = TELEMETRY_FRAME_SAMPLES;
+    frame[length++] = sequence++;
+    frame[length++] = sampleRooms;
+    frame[length++] = sampleCount;
+    put16(&frame[length], samplePeriod);
+    length += 2;
+
+    for (uint8_t i = 0; i < sampleRooms; i++)
+    {
+        put16(&frame[length], roomMinTemp[i]);
+        put16(&frame[length + 2], roomMaxTemp[i]);
+        length += SETPOINT_SIZE;
+    }
+
+    uint8_t samplesLength = sampleCount * SAMPLE_SIZE(sampleRooms);
+    memcpy(&frame[length], samples, samplesLength);
+    length += samplesLength;
+
+    uint16_t crc = 0xFFFF;
+    for (uint8_t i = 0; i < length; i++)
+        crc = _crc_ccitt_update(crc, frame[i]);
+    put16(&frame[length], crc);
+    length += CRC_SIZE;
+
+    encoded[0] = 0;
+    encodedLength = 1 + cobsEncode(frame, length, &encoded[1]);
+    encoded[encodedLength++] = 0;
+}
+
+static void takeSample()
+{
+    // A room added halfway a batch would change the layout, start a new batch
+    if (sampleCount && sampleRooms != roomCount)
+        sampleCount = 0;
+    sampleRooms = roomCount;
+
+    uint8_t *sample = &samples[sampleCount * SAMPLE_SIZE(sampleRooms)];
+    uint8_t heating = 0;
+
+    for (uint8_t i = 0; i < sampleRooms; i++)
+    {
+        if (roomState[i] & ROOM_HEATING)
+            heating |= 1 << i;
+        put16(&sample[1 + 2 * i], roomCurrentTemp[i]);
+    }
+    sample[0] = heating;
+
+    if (++sampleCount < batchSize)
+        return;
+
+    if (encodedLength)
+        dropped++;
+    else
+    {
+        buildFrame();
+        sendFrame();
+    }
+    sampleCount = 0;
+}
+
+void initTelemetry()
+{
+    setTelemetryRate(TELEMETRY_SAMPLE_MS, TELEMETRY_BATCH);
+}
+
+void setTelemetryRate(uint16_t sampleMs, uint8_t batch)
+{
+    if (batch < 1)
+        batch = 1;
+    if (batch > TELEMETRY_MAX_BATCH)
+        batch = TELEMETRY_MAX_BATCH;
+
+    removeTask(sampleTask);
+    sampleTask = SCHEDULER_NO_TASK;
+
+    samplePeriod = sampleMs;
+    batchSize = batch;
+    sampleCount = 0;
+
+    if (sampleMs)
+        sampleTask = addTask(takeSample, sampleMs, sampleMs);
+}
+
+uint16_t getTelemetryDropped()
+{
+    return dropped;
+}
@@ -0,0 +1,67 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <rooms.h>
+#include <usart.h>
+
+/*
+  Binary telemetry over the USART.
+
+  Every TELEMETRY_SAMPLE_MS the temperature and heating state of every room
+  is sampled, TELEMETRY_BATCH samples go out together in one frame. A frame
+  is COBS encoded and sent between two 0x00 bytes, the payload never holds
+  a 0x00 so a receiver finds the start of the next frame after any garbage,
+  text output included. A frame goes into the transmit buffer as a whole,
+  so other output can only come before or after it. That limits a frame to
+  TELEMETRY_MAX_BATCH samples: 8 for two rooms, 1 for eight rooms with the
+  default 64 byte transmit buffer. A bigger USART_TX_BUFFER_SIZE allows more.
+  tools/telemetry/decode.py reads the stream.
+
+  Payload, multi byte fields little endian:
+
+    type        1  TELEMETRY_FRAME_SAMPLES
+    sequence    1  counts frames, a gap means frames were lost
+    rooms       1  R
+    samples     1  N
+    period      2  milliseconds between two samples
+    setpoints   R x (min 2, max 2), tenths of a degree
+    samples     N x (heating 1 bit per room, R x temperature 2)
+    crc         2  CRC-16/CCITT (_crc_ccitt_update, start 0xFFFF) of the bytes above
+*/
+
+#define TELEMETRY_FRAME_SAMPLES 1
+
+#ifndef TELEMETRY_SAMPLE_MS
+#define TELEMETRY_SAMPLE_MS 1000
+#endif
+
+/* Bytes of a frame without its samples: header, setpoints, CRC, the COBS
+   code byte and the 0x00 in front and behind */
+#define TELEMETRY_FRAME_OVERHEAD (6 + 4 * MAX_NUMBER_OF_ROOMS + 2 + 3)
+#define TELEMETRY_SAMPLE_SIZE (1 + 2 * MAX_NUMBER_OF_ROOMS)
+
+/* Samples that fit in the transmit buffer in one frame, at most 8 */
+#define TELEMETRY_FIT_BATCH ((USART_TX_BUFFER_SIZE - 1 - TELEMETRY_FRAME_OVERHEAD) / TELEMETRY_SAMPLE_SIZE)
+#define TELEMETRY_MAX_BATCH (TELEMETRY_FIT_BATCH < 8 ? TELEMETRY_FIT_BATCH : 8)
+
+#ifndef TELEMETRY_BATCH
+#define TELEMETRY_BATCH (TELEMETRY_MAX_BATCH < 4 ? TELEMETRY_MAX_BATCH : 4)
+#endif
+
+/* Starts sampling with TELEMETRY_SAMPLE_MS and TELEMETRY_BATCH */
+void initTelemetry();
+
+/* Changes the rate, the batch being collected is thrown away.
+   A sample period of 0 stops the telemetry. */
+void setTelemetryRate(uint16_t sampleMs, uint8_t batch);
+
+/* Frames thrown away because the previous one was still being sent, or
+   because the scheduler had no slot left to retry a frame that did not fit */
+uint16_t getTelemetryDropped();
+
+/* Encodes length bytes, returns the encoded length which is at most
+   length + length / 254 + 1. out can't overlap data. */
+uint16_t cobsEncode(const uint8_t *data, uint16_t length, uint8_t *out);
+
+#endif
@@ -1,10 +1,17 @@
 
 /*
-  Quick and dirty functions that make serial communications work.
+  Interrupt driven serial communications.
 
-  Note that receiveByte() blocks -- it sits and waits _forever_ for
-   a byte to come in.  If you're doing anything that's more interesting,
-   you'll want to implement this with interrupts.
+  Outgoing bytes are copied into a ring buffer and shifted out by the
+   USART_UDRE interrupt, incoming bytes are stored in a second ring
+   buffer by the USART_RX interrupt.  Writing to the USART therefore
+   only costs a copy into SRAM and never waits: what does not fit in
+   the transmit buffer is dropped and counted.
+   Note that receiveByte() still blocks until a byte comes in, use
+   tryReceive() in anything that has to keep running.
+
+   The transmit functions are meant to be called from the main loop,
+   not from inside another interrupt.
 
    initUSART requires BAUDRATE to be defined in order to calculate
      the bit-rate multiplier.  9600 is a reasonable default.
@@ -16,10 +23,41 @@
     Correspondingly, the macros will just be defined as UDR.
 */
 
-#include <avr/io.h>
+#include <hal.h>
 #include <stdio.h>
+#include <string.h>
 #include <usart.h>
+#include <sram.h>
+#include <profile.h>
+#ifndef HAL_NATIVE
 #include <util/setbaud.h>
+#endif
+
+#if (USART_TX_BUFFER_SIZE & (USART_TX_BUFFER_SIZE - 1)) || USART_TX_BUFFER_SIZE > 256
+#error "USART_TX_BUFFER_SIZE must be a power of two, at most 256"
+#endif
+#if (USART_RX_BUFFER_SIZE & (USART_RX_BUFFER_SIZE - 1)) || USART_RX_BUFFER_SIZE > 256
+#error "USART_RX_BUFFER_SIZE must be a power of two, at most 256"
+#endif
+
+#define TX_MASK (USART_TX_BUFFER_SIZE - 1)
+#define RX_MASK (USART_RX_BUFFER_SIZE - 1)
+
+/* Keeps the compiler from moving buffer accesses past an index update */
+#define memoryBarrier() __asm__ __volatile__("" ::: "memory")
+
+/* The head is only written by the producer, the tail only by the consumer.
+   Both are single bytes, so they can be read without disabling interrupts. */
+static uint8_t txBuffer[USART_TX_BUFFER_SIZE];
+static volatile uint8_t txHead = 0;
+static volatile uint8_t txTail = 0;
+
+static uint8_t rxBuffer[USART_RX_BUFFER_SIZE];
+static volatile uint8_t rxHead = 0;
+static volatile uint8_t rxTail = 0;
+
+static volatile uint16_t txOverflows = 0;
+static volatile uint16_t rxOverflows = 0;
 
 void initUSART(void) {    /* requires BAUD */
     UBRR0H = UBRRH_VALUE; /* defined in setbaud.h */
@@ -29,38 +67,147 @@ void initUSART(void) {    /* requires BAUD */
 #else
     UCSR0A &= ~(1 << U2X0);
 #endif
-    /* Enable USART transmitter/receiver */
-    UCSR0B = (1 << TXEN0) | (1 << RXEN0);
+    /* Enable USART transmitter/receiver and the receive interrupt,
+       the data register empty interrupt is enabled once data is queued */
+    UCSR0B = (1 << TXEN0) | (1 << RXEN0) | (1 << RXCIE0);
     UCSR0C = (1 << UCSZ01) | (1 << UCSZ00); /* 8 data bits, 1 stop bit */
 
+#ifndef HAL_NATIVE /* on a pc stdout stays the terminal */
     static FILE my_stdout = FDEV_SETUP_STREAM(transmitChar, NULL, _FDEV_SETUP_RW);
     stdout = &my_stdout;
+#endif
+}
+
+/* Shifts out the next queued byte, stops itself when the buffer is empty */
+ISR(USART_UDRE_vect) {
+    PROFILE_SCOPE(PROFILE_ISR_USART_TX);
+    SRAM_ISR_PROBE(SRAM_ISR_USART_TX);
+
+    uint8_t tail = txTail;
+    if (tail == txHead) {
+        UCSR0B &= ~(1 << UDRIE0);
+        return;
+    }
+    UDR0 = txBuffer[tail];
+    txTail = (tail + 1) & TX_MASK;
+}
+
+ISR(USART_RX_vect) {
+    PROFILE_SCOPE(PROFILE_ISR_USART_RX);
+    SRAM_ISR_PROBE(SRAM_ISR_USART_RX);
+
+    uint8_t status = UCSR0A; /* has to be read before UDR0 */
+    uint8_t data = UDR0;
+    if (status & (1 << DOR0)) {
+        rxOverflows++; /* hardware lost a byte before this one */
+    }
+
+    uint8_t head = rxHead;
+    uint8_t next = (head + 1) & RX_MASK;
+    if (next == rxTail) {
+        rxOverflows++;
+        return;
+    }
+    rxBuffer[head] = data;
+    memoryBarrier();
+    rxHead = next;
+}
+
+uint8_t tryTransmit(uint8_t data) {
+    uint8_t head = txHead;
+    uint8_t next = (head + 1) & TX_MASK;
+    if (next == txTail) return 0;
+
+    txBuffer[head] = data;
+    memoryBarrier();
+    txHead = next;
+    UCSR0B |= (1 << UDRIE0);
+    return 1;
+}
+
+uint8_t transmitBuffer(const uint8_t *data, uint8_t length) {
+    uint8_t head = txHead;
+    uint8_t space = (txTail - head - 1) & TX_MASK;
+    if (length > space) length = space;
+    if (length == 0) return 0;
+
+    /* At most two copies, the second one when the data wraps around */
+    uint8_t first = USART_TX_BUFFER_SIZE - head;
+    if (first > length) first = length;
+    memcpy(&txBuffer[head], data, first);
+    memcpy(txBuffer, data + first, length - first);
+
+    memoryBarrier();
+    txHead = (head + length) & TX_MASK;
+    UCSR0B |= (1 << UDRIE0);
+    return length;
+}
+
+uint8_t tryReceive(uint8_t *data) {
+    uint8_t tail = rxTail;
+    if (tail == rxHead) return 0;
+
+    *data = rxBuffer[tail];
+    memoryBarrier();
+    rxTail = (tail + 1) & RX_MASK;
+    return 1;
 }
 
 int transmitChar(char character, FILE *stream) {
-    loop_until_bit_is_set(UCSR0A, UDRE0);
-    UDR0 = character;
+    transmitByte(character);
     return 0;
 }
 
 void transmitByte(uint8_t data) {
-    /* Wait for empty transmit buffer */
-    loop_until_bit_is_set(UCSR0A, UDRE0);
-    UDR0 = data; /* send data */
+    /* Never waits, a full buffer loses the byte */
+    if (!tryTransmit(data)) {
+        txOverflows++;
+    }
 }
 
 uint8_t receiveByte(void) {
-    loop_until_bit_is_set(UCSR0A, RXC0); /* Wait for incoming data */
-    return UDR0;                         /* return register value */
+    uint8_t data;
+    while (!tryReceive(&data)); /* Wait for incoming data */
+    return data;
+}
+
+void flushUSART(void) {
+    while (txHead != txTail) {
+        if (bit_is_clear(SREG, SREG_I)) return;
+    }
+    loop_until_bit_is_set(UCSR0A, UDRE0);
+}
+
+uint8_t getUSARTTxFree(void) {
+    return (txTail - txHead - 1) & TX_MASK;
+}
+
+uint16_t getUSARTTxOverflows(void) {
+    return txOverflows;
+}
+
+uint16_t getUSARTRxOverflows(void) {
+    uint16_t overflows;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        overflows = rxOverflows;
+    }
+    return overflows;
 }
 
 /* Here are a bunch of useful printing commands */
 
 void printString(const char myString[]) {
-    uint8_t i = 0;
-    while (myString[i]) {
-        transmitByte(myString[i]);
-        i++;
+    const uint8_t *data = (const uint8_t *) myString;
+    size_t length = strlen(myString);
+    while (length) {
+        uint8_t chunk = length > 255 ? 255 : length;
+        uint8_t sent = transmitBuffer(data, chunk);
+        data += sent;
+        length -= sent;
+        if (sent < chunk) { /* buffer full, the rest is lost */
+            txOverflows += length;
+            return;
+        }
     }
 }
 
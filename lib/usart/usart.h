@@ -2,13 +2,31 @@
 
    initUSART requires BAUD to be defined in order to calculate
      the bit-rate multiplier.
+
+   Transmit and receive are interrupt driven: outgoing bytes are
+   queued in a ring buffer that the USART_UDRE interrupt drains, and
+   incoming bytes are collected by the USART_RX interrupt.
+   Remember to enable interrupts with sei() after initUSART().
  */
+#include <stdint.h>
 #include <stdio.h>
 
+#ifndef USART_H
+#define USART_H
+
 #ifndef BAUD      /* if not defined in Makefile... */
 #define BAUD 9600 /* set a safe default baud rate */
 #endif
 
+/* Ring buffer sizes, must be a power of two and at most 256 */
+#ifndef USART_TX_BUFFER_SIZE
+#define USART_TX_BUFFER_SIZE 64
+#endif
+
+#ifndef USART_RX_BUFFER_SIZE
+#define USART_RX_BUFFER_SIZE 32
+#endif
+
 #define USART_HAS_DATA bit_is_set(UCSR0A, RXC0)
 #define USART_READY bit_is_set(UCSR0A, UDRE0)
 
@@ -19,12 +37,33 @@ void initUSART(void);
 
 int transmitChar(char character, FILE *stream);
 
-/* Blocking transmit and receive functions.
-   When you call receiveByte() your program will hang until
-   data comes through.  We'll improve on this later. */
+/* Non-blocking transmit and receive functions.
+   tryTransmit() returns 0 when the transmit buffer is full,
+   tryReceive() returns 0 when no data has come in yet. */
+uint8_t tryTransmit(uint8_t data);
+uint8_t tryReceive(uint8_t *data);
+
+/* Copies up to length bytes into the transmit buffer in one go,
+   returns the number of bytes that fitted */
+uint8_t transmitBuffer(const uint8_t *data, uint8_t length);
+
+/* Bytes that fit in the transmit buffer right now */
+uint8_t getUSARTTxFree(void);
+
+/* transmitByte() queues a byte and never waits, a byte that does not
+   fit is dropped and counted as a transmit overflow. Use flushUSART()
+   first to send more than the buffer holds without losing any.
+   receiveByte() still hangs until data comes through. */
 void transmitByte(uint8_t data);
 uint8_t receiveByte(void);
 
+/* Waits until every queued byte has left the shift register */
+void flushUSART(void);
+
+/* Number of bytes lost because a ring buffer was full */
+uint16_t getUSARTTxOverflows(void);
+uint16_t getUSARTRxOverflows(void);
+
 void printString(const char myString[]);
 /* Utility function to transmit an entire string from RAM */
 void readString(char myString[], uint8_t maxLength);
@@ -44,4 +83,6 @@ void printHexByte(uint8_t byte);
 /* Prints a byte out in hexadecimal */
 uint8_t getNumber(void);
 /* takes in up to three ascii digits,
- converts them to a byte when press enter */
\ No newline at end of file
+ converts them to a byte when press enter */
+
+#endif
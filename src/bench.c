@@ -0,0 +1,108 @@
+/*
+
+Firmware of the bench env ( pio run -e bench -t bench ), replaces main() of main.c
+
+It runs every hot path BENCH_RUNS times between BENCH_BEGIN / BENCH_END markers
+with interrupts disabled, so nothing else ends up in the numbers. After that it
+lets the interrupts run for a while, the tick interrupt carries its own markers
+and tools/bench/simbench presses a button so the button events run in it too.
+
+*/
+#ifdef BENCH
+
+#include <hal.h>
+
+#include <usart.h>
+#include <buttons.h>
+#include <display.h>
+#include <leds.h>
+#include <sensor.h>
+#include <bench.h>
+#include <scheduler.h>
+#include <control.h>
+
+#define BENCH_RUNS 16
+
+// Long enough for two full seconds of the timer interrupt
+#define BENCH_INTERRUPT_TIME_MS 2500
+
+#define BENCH_LINE "r1 21.5c min 18.0 max 21.0 heating\n"
+
+// from main.c
+void sampleButtonsTick();
+void createNewRoom(temperature_t min, temperature_t max);
+
+// from display.c
+void shift(uint8_t val, uint8_t bitorder);
+
+int main()
+{
+  initUSART();
+  initDisplay();
+  initADC();
+  initScheduler();
+  setTickHook(sampleButtonsTick);
+
+  enableAllButtons();
+  enableAllLeds();
+
+  createNewRoom(180, 210);
+  createNewRoom(160, 240);
+
+  // The expensive mode, the first tick of every run computes a new output
+  initControl();
+  for (uint8_t room = 0; room < roomCount; room++)
+  {
+    setControlMode(room, CONTROL_PID);
+    setControlTiming(room, 1, 0, 0);
+  }
+
+  for (uint8_t i = 0; i < BENCH_RUNS; i++)
+  {
+    // The transmit buffer has to be empty, otherwise printString drops bytes
+    sei();
+    flushUSART();
+    cli();
+
+    BENCH_BEGIN(BENCH_PRINT_STRING);
+    printString(BENCH_LINE);
+    BENCH_END(BENCH_PRINT_STRING);
+
+#ifndef DISPLAY_USE_SPI
+    BENCH_BEGIN(BENCH_SHIFT);
+    shift(0xA5, MSBFIRST);
+    BENCH_END(BENCH_SHIFT);
+#endif
+
+    BENCH_BEGIN(BENCH_WRITE_NUMBER);
+    writeNumber(2, 1, 5);
+    BENCH_END(BENCH_WRITE_NUMBER);
+
+    BENCH_BEGIN(BENCH_DISPLAY_REFRESH);
+    for (uint8_t digit = 0; digit < NUMBER_OF_DIGITS; digit++)
+      scanDisplay();
+    BENCH_END(BENCH_DISPLAY_REFRESH);
+
+    BENCH_BEGIN(BENCH_SAMPLE_BUTTONS);
+    sampleButtons();
+    BENCH_END(BENCH_SAMPLE_BUTTONS);
+
+    // Carries its own markers
+    controlTick();
+
+    BENCH_BEGIN(BENCH_READ_ADC);
+    readADC(4);
+    BENCH_END(BENCH_READ_ADC);
+  }
+
+  sei();
+  for (uint16_t i = 0; i < BENCH_INTERRUPT_TIME_MS; i++)
+    _delay_ms(1);
+
+  BENCH_BEGIN(BENCH_DONE);
+  while (1);
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,897 @@
+/*
+
+Serial command interface, see commands.h for the commands
+
+Bytes are taken from the USART receive buffer one at a time and collected in a
+line buffer, a complete line is split in words in place and looked up in the
+COMMANDS table in flash. The answer is built one line at a time and only when
+the transmit buffer has room for it, so neither a long dump nor a slow terminal
+ever makes the main loop wait. Nothing is allocated.
+
+*/
+#include <string.h>
+
+#include <hal.h>
+
+#include <usart.h>
+#include <rooms.h>
+#include <events.h>
+#include <scheduler.h>
+#include <power.h>
+#include <telemetry.h>
+#include <storage.h>
+#include <control.h>
+#include <history.h>
+#include <sram.h>
+#include <profile.h>
+
+#include "commands.h"
+#include "ui.h"
+
+#define MAX_WORDS 5
+#define OUTPUT_LINE_LENGTH 48
+
+_Static_assert(OUTPUT_LINE_LENGTH < USART_TX_BUFFER_SIZE, "A line of the answer is sent in one go");
+
+// Setpoints of "add room" without temperatures
+#define DEFAULT_MIN_TEMPERATURE 180
+#define DEFAULT_MAX_TEMPERATURE 210
+
+struct Command
+{
+  char name[10];
+  // Returns 0 when it worked or an error message in flash
+  const char *(*run)(uint8_t count, char *words[]);
+};
+
+static char line[COMMAND_LINE_LENGTH + 1];
+static uint8_t lineLength = 0;
+static uint8_t lineTooLong = 0;
+
+// The line of the answer that is being sent
+static char output[OUTPUT_LINE_LENGTH];
+static uint8_t outputLength = 0;
+
+// A command that answers with more than one line sets listLine, it writes line
+// index of the answer to output and returns 0 once there are no more lines
+static uint8_t (*listLine)(uint8_t index) = 0;
+static uint8_t listIndex = 0;
+
+// Rooms listed by "get", a single room adds its control settings
+static uint8_t firstListedRoom = 0;
+static uint8_t listedRooms = 0;
+static uint8_t listControl = 0;
+
+// Snapshot listed by "mem", so all of its lines are from the same moment
+static struct SramStats sramStats;
+
+static const char ISR_NAMES[SRAM_ISR_COUNT][8] PROGMEM = {
+  [SRAM_ISR_TIMER0] = "timer0",
+  [SRAM_ISR_TIMER2] = "timer2",
+  [SRAM_ISR_ADC] = "adc",
+  [SRAM_ISR_USART_TX] = "tx",
+  [SRAM_ISR_USART_RX] = "rx",
+  [SRAM_ISR_EEPROM] = "eeprom",
+};
+
+#ifdef PROFILE
+static const char PROFILE_NAMES[PROFILE_IDS][8] PROGMEM = {
+  [PROFILE_ISR_TIMER0] = "timer0",
+  [PROFILE_ISR_TIMER2] = "timer2",
+  [PROFILE_ISR_ADC] = "adc",
+  [PROFILE_ISR_USART_TX] = "tx",
+  [PROFILE_ISR_USART_RX] = "rx",
+  [PROFILE_ISR_EEPROM] = "eeprom",
+  [PROFILE_MAIN_LOOP] = "loop",
+  [PROFILE_TASKS] = "tasks",
+};
+#endif
+
+// Room and tier listed by "history"
+static uint8_t historyRoom = 0;
+static uint8_t historyTier = HISTORY_TIER_QUARTERS;
+
+/*
+
+Building the answer
+
+*/
+static void appendChar(char character)
+{
+  if (outputLength < OUTPUT_LINE_LENGTH)
+    output[outputLength++] = character;
+}
+
+// Appends a string from flash
+static void appendP(const char *text)
+{
+  char character;
+  while ((character = pgm_read_byte(text++)))
+    appendChar(character);
+}
+
+/*
+
+Appends a fixed point number
+
+@param value The number, 215 with 1 decimal is 21.5
+@param decimals How many of the digits are behind the point
+@return void
+
+*/
+static void appendNumber(int32_t value, uint8_t decimals)
+{
+  char digits[10];
+  uint8_t count = 0;
+
+  if (value < 0)
+  {
+    appendChar('-');
+    value = -value;
+  }
+
+  do
+  {
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  } while (value || count <= decimals);
+
+  while (count--)
+  {
+    appendChar(digits[count]);
+    if (count == decimals && decimals)
+      appendChar('.');
+  }
+}
+
+static void appendRoom(uint8_t room)
+{
+  appendChar('r');
+  appendNumber(room + 1, 0);
+  appendP(PSTR(" adc"));
+  appendNumber(roomSensorChannel[room], 0);
+  appendChar(' ');
+  appendNumber(roomCurrentTemp[room], 1);
+  appendP(PSTR(" min "));
+  appendNumber(roomMinTemp[room], 1);
+  appendP(PSTR(" max "));
+  appendNumber(roomMaxTemp[room], 1);
+  appendP(roomState[room] & ROOM_HEATING ? PSTR(" heating\n") : PSTR(" idle\n"));
+}
+
+/*
+
+Parsing the words of a command
+
+*/
+static uint8_t parseNumber(const char *text, uint16_t *value)
+{
+  uint32_t number = 0;
+
+  if (!*text)
+    return 0;
+
+  for (; *text; text++)
+  {
+    if (*text < '0' || *text > '9')
+      return 0;
+
+    number = number * 10 + (*text - '0');
+    if (number > 0xFFFF)
+      return 0;
+  }
+  *value = number;
+  return 1;
+}
+
+// Reads degrees with at most one decimal, "19.5" becomes 195 without floating point
+static uint8_t parseTemperature(const char *text, temperature_t *value)
+{
+  uint8_t negative = *text == '-';
+  if (negative)
+    text++;
+
+  char integer[5];
+  uint8_t length = 0;
+  while (*text && *text != '.')
+  {
+    if (length == sizeof(integer) - 1)
+      return 0;
+    integer[length++] = *text++;
+  }
+  integer[length] = '\0';
+
+  uint16_t degrees;
+  if (!parseNumber(integer, &degrees) || degrees > 999)
+    return 0;
+
+  uint8_t tenths = 0;
+  if (*text == '.')
+  {
+    text++;
+    if (*text < '0' || *text > '9' || text[1])
+      return 0;
+    tenths = *text - '0';
+  }
+
+  *value = degrees * TEMPERATURE_SCALE + tenths;
+  if (negative)
+    *value = -*value;
+  return 1;
+}
+
+// "r1" is room 0
+static uint8_t parseRoom(const char *text, uint8_t *room)
+{
+  uint16_t number;
+
+  if (*text != 'r' || !parseNumber(text + 1, &number))
+    return 0;
+  if (number < 1 || number > roomCount)
+    return 0;
+
+  *room = number - 1;
+  return 1;
+}
+
+// Reads a gain with at most one decimal into Q8.8, "1.5" becomes 384
+static uint8_t parseGain(const char *text, int16_t *gain)
+{
+  temperature_t tenths;
+
+  if (!parseTemperature(text, &tenths) || tenths < 0 || tenths > 1279)
+    return 0;
+
+  *gain = ((int32_t)tenths * 256 + 5) / 10;
+  return 1;
+}
+
+static uint8_t validSetpoints(temperature_t min, temperature_t max)
+{
+  return min >= 0 && max <= MAX_ROOM_TEMPERATURE && min < max;
+}
+
+/*
+
+Listings
+
+*/
+// Gains are Q8.8, shown with one decimal
+static void appendGain(const char *name, int16_t gain)
+{
+  appendP(name);
+  appendNumber(((int32_t)gain * 10 + 128) >> 8, 1);
+}
+
+static void appendControl(uint8_t room, uint8_t line)
+{
+  if (line == 0)
+  {
+    int16_t kp, ki, kd;
+    getControlGains(room, &kp, &ki, &kd);
+
+    appendP(getControlMode(room) == CONTROL_PID ? PSTR("  pid") : PSTR("  onoff"));
+    appendGain(PSTR(" kp "), kp);
+    appendGain(PSTR(" ki "), ki);
+    appendGain(PSTR(" kd "), kd);
+  }
+  else
+  {
+    uint8_t sampleTicks;
+    uint16_t minOn, minOff;
+    getControlTiming(room, &sampleTicks, &minOn, &minOff);
+
+    appendP(PSTR("  sample "));
+    appendNumber(sampleTicks, 0);
+    appendP(PSTR(" s minon "));
+    appendNumber(minOn, 0);
+    appendP(PSTR(" s minoff "));
+    appendNumber(minOff, 0);
+    appendP(PSTR(" s"));
+  }
+  appendChar('\n');
+}
+
+static uint8_t listRoomLine(uint8_t index)
+{
+  if (listControl && index > 0 && index < 3)
+  {
+    appendControl(firstListedRoom, index - 1);
+    return 1;
+  }
+
+  if (index >= listedRooms)
+    return 0;
+
+  appendRoom(firstListedRoom + index);
+  return 1;
+}
+
+static uint8_t listDumpLine(uint8_t index)
+{
+  if (index < roomCount)
+  {
+    appendRoom(index);
+    return 1;
+  }
+  index -= roomCount;
+
+  if (index < SCHEDULER_MAX_TASKS)
+  {
+    struct TaskStats stats;
+
+    // Free task slots leave the line empty
+    if (getTaskStats(index, &stats))
+    {
+      appendP(PSTR("task "));
+      appendNumber(index, 0);
+      appendP(PSTR(" runs "));
+      appendNumber(stats.runs, 0);
+      appendP(PSTR(" max "));
+      appendNumber(stats.maxRunMicros, 0);
+      appendP(PSTR("us over "));
+      appendNumber(stats.overruns, 0);
+      appendChar('\n');
+    }
+    return 1;
+  }
+  index -= SCHEDULER_MAX_TASKS;
+
+  if (index == 0)
+  {
+    appendP(PSTR("cpu load "));
+    appendNumber(getCpuLoad(), 1);
+    appendP(PSTR("%\n"));
+    return 1;
+  }
+
+  if (index == 1)
+  {
+    appendP(PSTR("lost tx "));
+    appendNumber(getUSARTTxOverflows(), 0);
+    appendP(PSTR(" rx "));
+    appendNumber(getUSARTRxOverflows(), 0);
+    appendP(PSTR(" events "));
+    appendNumber(getEventOverflows(), 0);
+    appendP(PSTR(" telemetry "));
+    appendNumber(getTelemetryDropped(), 0);
+    appendChar('\n');
+    return 1;
+  }
+
+  if (index == 2)
+  {
+    appendP(PSTR("eeprom writes "));
+    appendNumber(getStorageWrites(), 0);
+    appendChar('\n');
+    return 1;
+  }
+  return 0;
+}
+
+// Newest first, a bucket is named after when it started
+static uint8_t listHistoryLine(uint8_t index)
+{
+  struct HistoryEntry entry;
+
+  if (!getHistory(historyRoom, historyTier, index, &entry))
+    return 0;
+
+  if (historyTier == HISTORY_TIER_SECONDS)
+  {
+    appendNumber(-(int16_t)index, 0);
+    appendChar('s');
+  }
+  else
+  {
+    appendNumber(-(historyTier == HISTORY_TIER_MINUTES ? index + 1 : (index + 1) * 15), 0);
+    appendChar('m');
+  }
+
+  appendChar(' ');
+  appendNumber(entry.average, 1);
+  if (historyTier != HISTORY_TIER_SECONDS)
+  {
+    appendP(PSTR(" min "));
+    appendNumber(entry.min, 1);
+    appendP(PSTR(" max "));
+    appendNumber(entry.max, 1);
+  }
+  appendChar('\n');
+  return 1;
+}
+
+static uint8_t listMemLine(uint8_t index)
+{
+  switch (index)
+  {
+    case 0:
+      appendP(PSTR("data "));
+      appendNumber(sramStats.data, 0);
+      appendP(PSTR(" heap "));
+      appendNumber(sramStats.heap, 0);
+      appendChar('\n');
+      return 1;
+
+    case 1:
+      appendP(PSTR("heap free "));
+      appendNumber(sramStats.heapFree, 0);
+      appendP(PSTR(" blocks "));
+      appendNumber(sramStats.heapFreeBlocks, 0);
+      appendP(PSTR(" largest "));
+      appendNumber(sramStats.heapLargest, 0);
+      appendChar('\n');
+      return 1;
+
+    case 2:
+      appendP(PSTR("stack "));
+      appendNumber(sramStats.stack, 0);
+      appendP(PSTR(" max "));
+      appendNumber(sramStats.stackMax, 0);
+      appendP(PSTR(" unused "));
+      appendNumber(sramStats.unused, 0);
+      appendChar('\n');
+      return 1;
+  }
+  index -= 3;
+
+  if (index >= SRAM_ISR_COUNT)
+    return 0;
+
+  appendP(PSTR("isr "));
+  appendP(ISR_NAMES[index]);
+  appendP(PSTR(" stack "));
+  appendNumber(getIsrStack(index), 0);
+  appendChar('\n');
+  return 1;
+}
+
+#ifdef PROFILE
+// Four lines per id that ran: runs, cycles, period and the histogram in percent
+static uint8_t listProfileLine(uint8_t index)
+{
+  struct ProfileStats stats;
+  uint8_t id = index / 4;
+
+  if (id >= PROFILE_IDS)
+    return 0;
+
+  // Ids that never ran leave their lines empty
+  if (!getProfile(id, &stats))
+    return 1;
+
+  switch (index % 4)
+  {
+    case 0:
+      appendP(PROFILE_NAMES[id]);
+      appendP(PSTR(" runs "));
+      appendNumber(stats.count, 0);
+      break;
+
+    case 1:
+      appendP(PSTR("  cycles "));
+      appendNumber(stats.min, 0);
+      appendChar(' ');
+      appendNumber(stats.sum / stats.sumCount, 0);
+      appendChar(' ');
+      appendNumber(stats.max, 0);
+      break;
+
+    // Needs a second run, the line stays empty until then
+    case 2:
+      if (stats.count < 2)
+        return 1;
+
+      appendP(PSTR("  period "));
+      appendNumber(stats.minPeriod, 0);
+      appendChar(' ');
+      appendNumber(stats.maxPeriod, 0);
+      break;
+
+    case 3:
+    {
+      uint32_t total = 0;
+      for (uint8_t i = 0; i < PROFILE_BUCKETS; i++)
+        total += stats.buckets[i];
+
+      appendP(PSTR("  hist%"));
+      for (uint8_t i = 0; i < PROFILE_BUCKETS; i++)
+      {
+        appendChar(' ');
+        appendNumber((stats.buckets[i] * 100UL + total / 2) / total, 0);
+      }
+      break;
+    }
+  }
+  appendChar('\n');
+  return 1;
+}
+#endif
+
+static uint8_t listHelpLine(uint8_t index);
+
+/*
+
+Commands
+
+*/
+static const char *help(uint8_t count, char *words[])
+{
+  listLine = listHelpLine;
+  return 0;
+}
+
+static const char *get(uint8_t count, char *words[])
+{
+  firstListedRoom = 0;
+  listedRooms = roomCount;
+  listControl = 0;
+
+  if (count == 2)
+  {
+    if (!parseRoom(words[1], &firstListedRoom))
+      return PSTR("unknown room");
+    listedRooms = 1;
+    listControl = 1;
+  }
+  else if (count != 1)
+    return PSTR("usage: get [r1]");
+
+  listLine = listRoomLine;
+  return 0;
+}
+
+static const char *set(uint8_t count, char *words[])
+{
+  uint8_t room;
+  temperature_t temperature;
+
+  if (count != 4)
+    return PSTR("usage: set r1 min 19.5");
+  if (!parseRoom(words[1], &room))
+    return PSTR("unknown room");
+
+  if (strcmp_P(words[2], PSTR("sensor")) == 0)
+  {
+    uint16_t channel;
+    if (!parseNumber(words[3], &channel) || channel >= ADC_CHANNELS)
+      return PSTR("sensor is an adc channel 0 to 7");
+
+    roomSensorChannel[room] = channel;
+    settingsChanged();
+    return 0;
+  }
+
+  if (strcmp_P(words[2], PSTR("mode")) == 0)
+  {
+    if (strcmp_P(words[3], PSTR("onoff")) == 0)
+      setControlMode(room, CONTROL_ONOFF);
+    else if (strcmp_P(words[3], PSTR("pid")) == 0)
+      setControlMode(room, CONTROL_PID);
+    else
+      return PSTR("mode is onoff or pid");
+
+    settingsChanged();
+    return 0;
+  }
+
+  int16_t gains[3];
+  getControlGains(room, &gains[0], &gains[1], &gains[2]);
+
+  static const char GAIN_NAMES[3][3] PROGMEM = {"kp", "ki", "kd"};
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    if (strcmp_P(words[2], GAIN_NAMES[i]) != 0)
+      continue;
+
+    if (!parseGain(words[3], &gains[i]))
+      return PSTR("gain is 0.0 to 127.9");
+
+    setControlGains(room, gains[0], gains[1], gains[2]);
+    settingsChanged();
+    return 0;
+  }
+
+  uint8_t sampleTicks;
+  uint16_t timing[2];
+  getControlTiming(room, &sampleTicks, &timing[0], &timing[1]);
+
+  // A control tick is CONTROL_TICK_MS, one second
+  if (strcmp_P(words[2], PSTR("sample")) == 0)
+  {
+    uint16_t seconds;
+    if (!parseNumber(words[3], &seconds) || seconds < 1 || seconds > 255)
+      return PSTR("sample is 1 to 255 s");
+
+    setControlTiming(room, seconds, timing[0], timing[1]);
+    settingsChanged();
+    return 0;
+  }
+
+  static const char TIMING_NAMES[2][7] PROGMEM = {"minon", "minoff"};
+  for (uint8_t i = 0; i < 2; i++)
+  {
+    if (strcmp_P(words[2], TIMING_NAMES[i]) != 0)
+      continue;
+
+    if (!parseNumber(words[3], &timing[i]))
+      return PSTR("minimum time is 0 to 65535 s");
+
+    setControlTiming(room, sampleTicks, timing[0], timing[1]);
+    settingsChanged();
+    return 0;
+  }
+
+  if (!parseTemperature(words[3], &temperature))
+    return PSTR("bad temperature");
+
+  temperature_t min = roomMinTemp[room];
+  temperature_t max = roomMaxTemp[room];
+
+  if (strcmp_P(words[2], PSTR("min")) == 0)
+    min = temperature;
+  else if (strcmp_P(words[2], PSTR("max")) == 0)
+    max = temperature;
+  else
+    return PSTR("unknown setting");
+
+  if (!validSetpoints(min, max))
+    return PSTR("min must be below max, max at most 40.0");
+
+  roomMinTemp[room] = min;
+  roomMaxTemp[room] = max;
+  uiNotify(UI_DATA_SETPOINTS);
+  settingsChanged();
+  return 0;
+}
+
+static const char *add(uint8_t count, char *words[])
+{
+  temperature_t min = DEFAULT_MIN_TEMPERATURE;
+  temperature_t max = DEFAULT_MAX_TEMPERATURE;
+
+  if ((count != 2 && count != 4) || strcmp_P(words[1], PSTR("room")) != 0)
+    return PSTR("usage: add room [18.0 21.0]");
+
+  if (count == 4)
+  {
+    if (!parseTemperature(words[2], &min) || !parseTemperature(words[3], &max))
+      return PSTR("bad temperature");
+    if (!validSetpoints(min, max))
+      return PSTR("min must be below max, max at most 40.0");
+  }
+
+  int8_t room = addRoom(min, max);
+  if (room < 0)
+    return PSTR("no room left");
+  settingsChanged();
+
+  appendChar('r');
+  appendNumber(room + 1, 0);
+  appendChar('\n');
+  return 0;
+}
+
+static const char *telemetry(uint8_t count, char *words[])
+{
+  uint16_t period;
+  uint16_t batch;
+
+  if (count != 3 || !parseNumber(words[1], &period) || !parseNumber(words[2], &batch))
+    return PSTR("usage: telemetry 1000 4");
+  if (period > 0x7FFF || batch < 1 || batch > TELEMETRY_MAX_BATCH)
+    return PSTR("period up to 32767 ms, batch too big for the transmit buffer");
+
+  setTelemetryRate(period, batch);
+  return 0;
+}
+
+static const char *history(uint8_t count, char *words[])
+{
+  historyTier = HISTORY_TIER_QUARTERS;
+
+  if (count != 2 && count != 3)
+    return PSTR("usage: history r1 [s|m|q]");
+  if (!parseRoom(words[1], &historyRoom))
+    return PSTR("unknown room");
+
+  if (count == 3)
+  {
+    if (strcmp_P(words[2], PSTR("s")) == 0)
+      historyTier = HISTORY_TIER_SECONDS;
+    else if (strcmp_P(words[2], PSTR("m")) == 0)
+      historyTier = HISTORY_TIER_MINUTES;
+    else if (strcmp_P(words[2], PSTR("q")) != 0)
+      return PSTR("s, m or q");
+  }
+
+  listLine = listHistoryLine;
+  return 0;
+}
+
+static const char *mem(uint8_t count, char *words[])
+{
+  getSramStats(&sramStats);
+  listLine = listMemLine;
+  return 0;
+}
+
+static const char *prof(uint8_t count, char *words[])
+{
+#ifdef PROFILE
+  if (count == 2 && strcmp_P(words[1], PSTR("reset")) == 0)
+  {
+    resetProfile();
+    return 0;
+  }
+  if (count != 1)
+    return PSTR("usage: prof [reset]");
+
+  listLine = listProfileLine;
+  return 0;
+#else
+  return PSTR("build with -D PROFILE");
+#endif
+}
+
+static const char *dump(uint8_t count, char *words[])
+{
+  listLine = listDumpLine;
+  return 0;
+}
+
+static const struct Command COMMANDS[] PROGMEM = {
+  {"help", help},
+  {"get", get},
+  {"set", set},
+  {"add", add},
+  {"telemetry", telemetry},
+  {"history", history},
+  {"mem", mem},
+  {"prof", prof},
+  {"dump", dump},
+};
+
+#define COMMAND_COUNT (sizeof(COMMANDS) / sizeof(COMMANDS[0]))
+
+static uint8_t listHelpLine(uint8_t index)
+{
+  if (index >= COMMAND_COUNT)
+    return 0;
+
+  appendP(COMMANDS[index].name);
+  appendChar('\n');
+  return 1;
+}
+
+/*
+
+Splits the line in words and runs the command, the answer ends up in output
+
+*/
+static void runLine()
+{
+  char *words[MAX_WORDS];
+  uint8_t count = 0;
+  char *cursor = line;
+
+  while (*cursor)
+  {
+    if (*cursor == ' ')
+    {
+      *cursor++ = '\0';
+      continue;
+    }
+
+    if (count == MAX_WORDS)
+    {
+      appendP(PSTR("error: too many words\n"));
+      return;
+    }
+
+    words[count++] = cursor;
+    while (*cursor && *cursor != ' ')
+      cursor++;
+  }
+
+  if (!count)
+    return;
+
+  struct Command command;
+  for (uint8_t i = 0; i < COMMAND_COUNT; i++)
+  {
+    memcpy_P(&command, &COMMANDS[i], sizeof(command));
+    if (strcmp(words[0], command.name) != 0)
+      continue;
+
+    const char *error = command.run(count, words);
+    if (error)
+    {
+      listLine = 0;
+      outputLength = 0;
+      appendP(PSTR("error: "));
+      appendP(error);
+      appendChar('\n');
+    }
+    else if (!listLine)
+      appendP(PSTR("ok\n"));
+    return;
+  }
+  appendP(PSTR("error: unknown command, try help\n"));
+}
+
+// Collects one received byte, runs the line when it is complete
+static void receive(char character)
+{
+  if (character == '\r' || character == '\n')
+  {
+    line[lineLength] = '\0';
+    if (lineTooLong)
+      appendP(PSTR("error: line too long\n"));
+    else
+      runLine();
+
+    lineLength = 0;
+    lineTooLong = 0;
+    return;
+  }
+
+  // Backspace from a terminal
+  if (character == '\b' || character == 0x7F)
+  {
+    if (lineLength)
+      lineLength--;
+    return;
+  }
+
+  if (lineLength < COMMAND_LINE_LENGTH)
+    line[lineLength++] = character;
+  else
+    lineTooLong = 1;
+}
+
+// Returns 1 once the output line is in the transmit buffer
+static uint8_t sendOutput()
+{
+  // Whole lines only, so they never end up in the middle of a telemetry frame
+  if (outputLength)
+  {
+    if (getUSARTTxFree() < outputLength)
+      return 0;
+    transmitBuffer((const uint8_t *)output, outputLength);
+  }
+
+  outputLength = 0;
+  return 1;
+}
+
+void runCommand(const char *command)
+{
+  strncpy(line, command, COMMAND_LINE_LENGTH);
+  line[COMMAND_LINE_LENGTH] = '\0';
+  runLine();
+}
+
+void pollCommands()
+{
+  uint8_t data;
+
+  while (sendOutput())
+  {
+    if (listLine)
+    {
+      if (!listLine(listIndex++))
+      {
+        listLine = 0;
+        listIndex = 0;
+        appendP(PSTR("ok\n"));
+      }
+      continue;
+    }
+
+    // The next command is only read once the answer to the previous one is out
+    if (!tryReceive(&data))
+      return;
+    receive(data);
+  }
+}
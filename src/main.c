@@ -1,11 +1,8 @@
 // Default C libraries
 #include <stdio.h>
-#include <stdlib.h>
-#include <util/delay.h>
-#include <avr/io.h>
 
-// Interrupts
-#include <avr/interrupt.h>
+// Registers, interrupts and delays
+#include <hal.h>
 
 // Custom added libraries
 #include <usart.h>
@@ -14,56 +11,31 @@
 #include <leds.h>
 #include <sensor.h>
 
-// Finals
-#define MAX_ROOM_NAME_LENGTH 3
-#define MAX_NUMBER_OF_ROOMS 2
-
-#define MAX_ROOM_TEMPERATURE 400
+#include <rooms.h>
+#include <bench.h>
+#include <events.h>
+#include <scheduler.h>
+#include <power.h>
+#include <telemetry.h>
+#include <storage.h>
+#include <control.h>
+#include <pwm.h>
+#include <history.h>
+#include <profile.h>
+
+#include "ui.h"
+#include "commands.h"
 
+// Finals
 #define DEBUG_TIMEOUT 500
 
-#define TEMP_SENSOR PC4
-
-volatile uint32_t counter = 0;
-volatile uint16_t overflow_count = 0;
-
-// Array of pointers to the structs
-struct Thermostat **rooms;
-
-// helper variable to the **rooms
-int roomCounter = 0;
-
-// which of the different screens is displayed [ 0: room selector; 1: Specific room; 2: detail ]
-int currentScreen = 0;
-
-// Determines which room is displayed on the homescreen
-int currentRoom = 0;
-
-// Choose the tab [ 0: MIN; 1: MAX; 2: BACK ]
-int selectedTab = 0;
-
-// set this to 1 to display the current temperature measured by the sensor
-int showCurrentTemp = 0;
-
-// The temperature from the sensor
-int sensor;
-
-/*
-
-Thermostat struct, has the possibility to scale horizontally ( multiple rooms )
-
-*/
-struct Thermostat
-{
-  char roomName[MAX_ROOM_NAME_LENGTH];
-  int minTemp;
-  int maxTemp;
-};
+// Build with -D POWER_REPORT to print the cpu load every POWER_REPORT_MS
+#define POWER_REPORT_MS 10000
 
 /*
 
 Aesthetic function
-Mallocs memory for the 4 rooms that can be initialised
+The rooms live in the static room store ( lib/rooms ), nothing has to be allocated
 
 */
 void initThermostateSystem()
@@ -71,307 +43,153 @@ void initThermostateSystem()
   printString("\nStarting thermostat, please wait patient ...\n");
   _delay_ms(DEBUG_TIMEOUT);
   printString("Create room environment...\n");
-
-  rooms = (struct Thermostat **) malloc(MAX_NUMBER_OF_ROOMS * sizeof(struct Thermostat *));
-
-  // Makes sure that the malloc was succesfull;
-  if (rooms == NULL)
-  {
-    printString("Memory allocation failed for rooms\n");
-    return;
-  }
-
   _delay_ms(DEBUG_TIMEOUT);
   printString("Starting succesfully ...\n");
 }
 
 /*
 
-This function is going to create a new struct of Thermostat and will push a pointer to the new struct in the **rooms array
+This function is going to add a new room to the room store, the room is called r1, r2, ... after its position
 
-@param min The minimum temperature the room can to be
-@param max The maximum temperature the room can be
+@param min The minimum temperature the room can to be, in tenths of a degree
+@param max The maximum temperature the room can be, in tenths of a degree
 @return void
 
 */
-void createNewRoom(int min, int max)
+void createNewRoom(temperature_t min, temperature_t max)
 { 
-  if (roomCounter >= MAX_NUMBER_OF_ROOMS)
+  if (addRoom(min, max) < 0)
   {
     printString("Max number of rooms reached\n");
-    return;
-  }
-
-  struct Thermostat *pt = (struct Thermostat *) malloc(sizeof(struct Thermostat));
-
-  if (pt == NULL)
-  {
-    printString("Memory allocation failed for new room\n");
-    return;
   }
-
-  char name[MAX_ROOM_NAME_LENGTH];
-  sprintf(name, "r%d", roomCounter + 1);
-
-  snprintf(pt -> roomName, MAX_ROOM_NAME_LENGTH, "%s", name);
-
-  pt -> minTemp = min;
-  pt -> maxTemp = max;
-
-  rooms[roomCounter] = pt;
-  roomCounter ++;
 }
 
 /*
 
-Helper function for adjusting the min and max parameters of the existing rooms
-
-@param increase This parameter determines whether or not we want to increase or decrease min / max (bool)
-@return void
+Samples the buttons every BUTTON_SAMPLE_MS, called from systemTick()
 
 */
-void adjustCurrentRoomTemperature(int increase)
+void sampleButtonsTick()
 {
-  // Min temperature
-  if (selectedTab == 0)
-  {
-    if (increase)
-    {
-      // Min and Max cannot be equal to eachother
-      if (rooms[currentRoom]->minTemp + 1 >= rooms[currentRoom]->maxTemp)
-        return;
-
-      rooms[currentRoom]->minTemp++;
-      return;
-    }
+  static uint8_t ticks = 0;
 
-    // Decrease current room min temperature
-    if (rooms[currentRoom]->minTemp - 1 < 0)
-      return; 
-      
-    rooms[currentRoom]->minTemp--;
+  if (++ticks < BUTTON_SAMPLE_MS)
     return;
-  }
+  ticks = 0;
 
-  // Max temperature
-  if (selectedTab == 1)
-  {
-    if (increase)
-    {
-      // Set the ceiling to the final
-      if (rooms[currentRoom]->maxTemp + 1 > MAX_ROOM_TEMPERATURE)
-        return;
+  sampleButtons();
 
-      rooms[currentRoom]->maxTemp++;
-      return;
-    }
+  uint8_t event;
+  while ((event = nextButtonEvent()) != BUTTON_NO_EVENT)
+    pushEvent(EVENT_BUTTON, event);
+}
 
-    // Decrease current room max temperature
-    if (rooms[currentRoom]->maxTemp-1 == rooms[currentRoom]->minTemp || rooms[currentRoom]->maxTemp-1 == 0)
-      return;
+/*
 
-    rooms[currentRoom]->maxTemp--;
-  }
+Runs every millisecond from the scheduler tick: the heater outputs and the buttons
+
+*/
+void systemTick()
+{
+  pwmTick();
+  sampleButtonsTick();
 }
 
 /*
 
-  This is a helper function to break down a number into three ints so we can display it
-  Don't forget to free the memory when the numbers are no longer needed!
-
-  @param num Number that you want to break down
-  @return pointer returns a pointer to the array where the three ints are stored
+Scans the sensor of every room in one go, the results arrive as EVENT_SENSOR_READY
+Rooms can share a sensor, every channel is only converted once
 
 */
-int* formatNumberToDisplay(int num) {
-    int firstDigit = num / 100; // 263 / 100 = 2
-    int secondDigit = (num / 10) % 10; // (263 / 10) % 10 = 6
-    int decimalDigit = num % 10; // 263 % 10 = 3
-
-    int *pArr = malloc(3 * sizeof(int));
-    if (pArr == NULL) {
-        return NULL;
-    }
+void measureTemperature()
+{
+  uint8_t channels = 0;
 
-    pArr[0] = firstDigit;
-    pArr[1] = secondDigit;
-    pArr[2] = decimalDigit;
+  for (uint8_t i = 0; i < roomCount; i++)
+    channels |= 1 << roomSensorChannel[i];
 
-    return pArr;
+  startADCScan(channels);
 }
 
+#ifdef POWER_REPORT
 /*
 
-  handles the timer for the leds
+Prints how much of the time the cpu was awake since the previous report
 
 */
-void initTimer0() {
-    // Set the timer to Normal mode (no PWM, just counting)
-    TCCR0A = 0; // WGM00 = 0 and WGM01 = 0 --> Normal mode
+void reportCpuLoad()
+{
+  uint16_t load = getCpuLoad();
+  printf("cpu load %u.%u%%\n", load / 10, load % 10);
+}
+#endif
 
-    // Set prescaler to 1024
-    TCCR0B |= _BV(CS02) | _BV(CS00); // CS02 = 1 and CS00 = 1 --> prescaler factor is now 1024
+/*
 
-    // Enable overflow interrupt
-    TIMSK0 |= _BV(TOIE0); // overflow interrupt enable
-}
+Adds the temperature of every room to its history, once per second as a task
 
-ISR(TIMER0_OVF_vect) {
-    overflow_count++;
-    if (overflow_count >= 61) // 15625 / 256 ≈ 61 
-    {
-      //printString("Interrupt every second\n");
-      counter++;
-      overflow_count = 0;
-
-      sensor = (readADC(4) * 4.22) / 10;
-
-      for (int i = 0; i < roomCounter; i++)
-      {
-        if (sensor * 10 < rooms[i]->minTemp)
-        {
-          turnLedOn(i);
-          continue;
-        }
-        turnDownLed(i);
-      }
-    }
+*/
+void recordHistory()
+{
+  if (historyTick())
+    uiNotify(UI_DATA_HISTORY);
 }
 
 /*
 
-Handle the interrupts coming from the buttons
+Runs the control loops of every room, once per second as a task ( see lib/control )
+PWM channel i drives output i, the heater and LED of room i. An on/off room
+gives a duty of 0 or CONTROL_DUTY_MAX, which the channel follows without waiting
+for its next window. A PID room shows ROOM_HEATING while its PWM output is on.
 
 */
-ISR(PCINT1_vect)
+void controlRooms()
 {
-  // Left button
-  if (buttonPushed(0))
+  controlTick();
+
+  for (uint8_t i = 0; i < MAX_NUMBER_OF_ROOMS; i++)
   {
-    // Debounce
-    _delay_us(1000);
+    setPwmDuty(i, i < roomCount ? getControlOutput(i) : 0);
 
-    if (buttonPushed(0))
+    if (i < roomCount && getControlMode(i) == CONTROL_PID)
     {
-      // Room selector
-      if (currentScreen == 0)
-      {
-        if (currentRoom == 0)
-          return;
-
-        if (showCurrentTemp)
-        {
-          showCurrentTemp = 0;
-          return;
-        }
-
-        currentRoom--;
-      }
-
-      // Room details
-      if (currentScreen == 1)
-      {
-        if (selectedTab == 0)
-          return;
-
-        selectedTab--;
-      }
-
-      // Change min / max temperature
-      if (currentScreen == 2)
-        adjustCurrentRoomTemperature(0);
-
+      if (getPwmOutput(i))
+        roomState[i] |= ROOM_HEATING;
+      else
+        roomState[i] &= ~ROOM_HEATING;
     }
-    return;
   }
+}
 
-  // Center button
-  if (buttonPushed(1))
-  {
-    // Debounce
-    _delay_us(1000);
+/*
 
-    if (buttonPushed(1))
-    {
-      // Back button on details screen
-      if (currentScreen == 2)
-      {
-        currentScreen = 1;
-        selectedTab = 0;
-        return;
-      }
-
-      // Select button on specific rooms screen
-      if (currentScreen == 1)
-      {
-        // Min/Max temperatuur of room 
-        if (selectedTab == 0 || selectedTab == 1)
-        {
-          currentScreen = 2;
-          return;
-        }
-
-        // Back button
-        if (selectedTab == 2)
-        {
-          currentScreen = 0;
-          selectedTab = 0;
-          return;
-        }
-      }
-
-      // Room selector
-      if (currentScreen == 0)
-      {
-        // room details
-        currentScreen = 1;
-        return;
-      }
-    }
-    return;
-  }
+Handles one event from the queue, every change of the application state happens here
+
+@param event The event popped from the queue
+@return void
 
-  // Right button
-  if (buttonPushed(2))
+*/
+void handleEvent(struct Event *event)
+{
+  switch (event->type)
   {
-    // Debounce
-    _delay_us(1000);
+    case EVENT_BUTTON:
+      uiHandleButton(event->data);
+      break;
 
-    if (buttonPushed(2))
-    {
-      // Room selector
-      if (currentScreen == 0)
-      {
-        if (currentRoom+1 >= roomCounter && !showCurrentTemp)
-        {
-          showCurrentTemp = 1;
-          return;
-        }
-
-        if (showCurrentTemp)
-          return;
-        
-        currentRoom++;
-        return;
-      }
-
-      // Room details
-      if (currentScreen == 1)
-      {
-        if (selectedTab == 2)
-          return;
-
-        selectedTab++;
-        return;
-      }
-
-      if (currentScreen == 2)
-        adjustCurrentRoomTemperature(1);
-    }
-    return;
+    case EVENT_SENSOR_READY:
+      updateTemperatures(event->data);
+
+      for (uint8_t i = 0; i < roomCount; i++)
+        roomCurrentTemp[i] = getChannelTemperature(roomSensorChannel[i]);
+
+      uiNotify(UI_DATA_TEMPERATURE);
+      break;
   }
 }
 
+// Unit tests bring their own main() and call into this file, the bench build uses src/bench.c
+#if !defined(PIO_UNIT_TESTING) && !defined(BENCH)
 int main()
 {
   // debounce
@@ -382,7 +200,11 @@ int main()
   initUSART(); 
   initDisplay();
   initADC();
-  initTimer0();
+  initScheduler();
+
+  // The USART needs interrupts to empty its transmit buffer
+  sei();
+
   initThermostateSystem();
 
   enableAllButtons();
@@ -390,77 +212,66 @@ int main()
 
   enableAllLeds();
 
-  sei();
-
   // End of initialisation
 
-  createNewRoom(180, 210);
-  createNewRoom(160, 240);
+  // The rooms of the last run with their control modes, the default rooms the first time
+  initControl();
+  if (!loadSettings())
+  {
+    createNewRoom(180, 210);
+    createNewRoom(160, 240);
+  }
+
+  uiInit();
+
+  setTickHook(systemTick);
+
+  // The measurement is done long before the control loop runs
+  addTask(measureTemperature, 1000, 0);
+  initPwm();
+  addTask(controlRooms, CONTROL_TICK_MS, 500);
+
+  initHistory();
+  addTask(recordHistory, 1000, 750);
+
+  // Binary frames for tools/telemetry/decode.py, every TELEMETRY_SAMPLE_MS
+  initTelemetry();
 
-  int * numbers;
+#ifdef POWER_REPORT
+  addTask(reportCpuLoad, POWER_REPORT_MS, POWER_REPORT_MS);
+#endif
+
+  // Timer1 counts cycles for the prof command, only in a -D PROFILE build
+  initProfiler();
+
+  // How much SRAM is left, the answer of the mem command goes out with the first poll
+  runCommand("mem");
+
+  struct Event event;
 
   while (1)
   {
-    // Room selector
-    if (currentScreen == 0 && !showCurrentTemp)
-    {
-      writeCharToSegment(0, 'r');
-      writeNumberToSegment(1, currentRoom+1);
-      continue;
-    }
+    PROFILE_ENTER(PROFILE_MAIN_LOOP);
 
-    if (currentScreen == 0 && showCurrentTemp)
-    {
-      numbers = formatNumberToDisplay(sensor * 10);
+    while (popEvent(&event))
+      handleEvent(&event);
 
-      writeNumber(numbers[0], numbers[1], numbers[2]);
-      free(numbers);
-      continue;
-    }
+    PROFILE_ENTER(PROFILE_TASKS);
+    runTasks();
+    PROFILE_LEAVE(PROFILE_TASKS);
 
-    if (currentScreen == 1)
-    {
-      if (selectedTab == 0)
-      {
-        writeString("min");
-        continue;
-      }
-
-      if (selectedTab == 1)
-      {
-        writeString("max");
-        continue;
-      }
-
-      if (selectedTab == 2)
-      {
-        writeString("back");
-        continue;
-      }
-    }
+    // Commands from the serial port, answers go out as the transmit buffer empties
+    pollCommands();
 
-    if (currentScreen == 2)
-    {
-      if (selectedTab == 0)
-      {
-        numbers = formatNumberToDisplay(rooms[currentRoom]->minTemp);
-        
-        writeNumber(numbers[0], numbers[1], numbers[2]);
-        free(numbers);
-        continue;
-      }
-
-      if (selectedTab == 1)
-      {
-        numbers = formatNumberToDisplay(rooms[currentRoom]->maxTemp);
-        
-        writeNumber(numbers[0], numbers[1], numbers[2]);
-        free(numbers);
-        continue;
-      }
-    }
+    PROFILE_LEAVE(PROFILE_MAIN_LOOP);
 
+    // Nothing left to do, sleep until an interrupt brings new work
+    cli();
+    if (!eventsPending() && nextTaskDue() > 0)
+      sleepUntilInterrupt(adcSampling());
+    sei();
   }
 
   return 0;
-}
\ No newline at end of file
+}
+#endif
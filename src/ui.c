@@ -0,0 +1,337 @@
+/*
+
+User interface of the thermostat as a table driven state machine
+
+Every screen is a state. A button event is turned into an input and the transition
+table, which lives in flash, gives the next state and an optional action for every
+state and input. The display is only rendered when a state is entered or when the
+data it shows changes. A new screen needs a state, a row in TRANSITIONS and an entry
+in SCREENS, nothing else has to change.
+
+*/
+#include <hal.h>
+
+#include <buttons.h>
+#include <display.h>
+#include <rooms.h>
+#include <storage.h>
+#include <history.h>
+
+#include "ui.h"
+
+// States, UI_NONE in the table means the input is ignored
+#define UI_NONE 0
+#define UI_ROOM 1
+#define UI_CURRENT_TEMP 2
+#define UI_MENU_MIN 3
+#define UI_MENU_MAX 4
+#define UI_MENU_BACK 5
+#define UI_EDIT_MIN 6
+#define UI_EDIT_MAX 7
+#define UI_HISTORY 8
+#define UI_HISTORY_AGE 9
+#define UI_STATE_COUNT 10
+
+// Inputs
+#define UI_LEFT 0
+#define UI_CENTER 1
+#define UI_RIGHT 2
+#define UI_LEFT_HOLD 3
+#define UI_RIGHT_HOLD 4
+#define UI_LEFT_FAST 5
+#define UI_RIGHT_FAST 6
+#define UI_INPUT_COUNT 7
+#define UI_NO_INPUT 0xFF
+
+/*
+
+An action runs before the state changes, it gets the next state from the table
+and returns the state to go to, which lets it stay put or pick another one
+
+*/
+struct Transition
+{
+  uint8_t next;
+  uint8_t (*action)(uint8_t next);
+};
+
+struct Screen
+{
+  void (*render)();
+  uint8_t shows; // UI_DATA_* bits
+};
+
+static uint8_t uiState = UI_ROOM;
+
+// Determines which room is displayed on the homescreen
+static uint8_t currentRoom = 0;
+
+// The history screen shows the average of one hour, 1 is the last hour
+#define HISTORY_HOURS (HISTORY_QUARTERS / 4)
+static uint8_t historyHour = 1;
+
+/*
+
+Actions
+
+*/
+static uint8_t previousRoom(uint8_t next)
+{
+  if (currentRoom > 0)
+    currentRoom--;
+  return next;
+}
+
+static uint8_t nextRoom(uint8_t next)
+{
+  // Past the last room comes the current temperature
+  if (currentRoom + 1 >= roomCount)
+    return next;
+
+  currentRoom++;
+  return UI_ROOM;
+}
+
+static uint8_t firstHistoryHour(uint8_t next)
+{
+  historyHour = 1;
+  return next;
+}
+
+// Only as far back as there are 15 minute buckets
+static uint8_t olderHour(uint8_t next)
+{
+  if (historyHour < HISTORY_HOURS && getHistoryCount(currentRoom, HISTORY_TIER_QUARTERS) > historyHour * 4)
+    historyHour++;
+  return next;
+}
+
+// Newer than the last hour is the current temperature
+static uint8_t newerHour(uint8_t next)
+{
+  if (historyHour == 1)
+    return next;
+
+  historyHour--;
+  return uiState;
+}
+
+/*
+
+Helper function for adjusting the min and max parameters of the current room
+
+@param step How many tenths of a degree the temperature changes, negative to decrease
+@return the state to stay in
+
+*/
+static uint8_t adjustCurrentRoomTemperature(temperature_t step)
+{
+  temperature_t min = roomMinTemp[currentRoom];
+  temperature_t max = roomMaxTemp[currentRoom];
+
+  if (uiState == UI_EDIT_MIN)
+  {
+    min += step;
+
+    // Min and Max cannot be equal to eachother
+    if (min >= max)
+      min = max - 1;
+
+    if (min < 0)
+      min = 0;
+
+    roomMinTemp[currentRoom] = min;
+  }
+  else
+  {
+    max += step;
+
+    // Set the ceiling to the final
+    if (max > MAX_ROOM_TEMPERATURE)
+      max = MAX_ROOM_TEMPERATURE;
+
+    if (max <= min)
+      max = min + 1;
+
+    roomMaxTemp[currentRoom] = max;
+  }
+
+  // Holding a button makes many changes, they end up in one save
+  settingsChanged();
+  return uiState;
+}
+
+static uint8_t lowerSetpoint(uint8_t next) { return adjustCurrentRoomTemperature(-1); }
+static uint8_t raiseSetpoint(uint8_t next) { return adjustCurrentRoomTemperature(1); }
+static uint8_t lowerSetpointFast(uint8_t next) { return adjustCurrentRoomTemperature(-10); }
+static uint8_t raiseSetpointFast(uint8_t next) { return adjustCurrentRoomTemperature(10); }
+
+/*
+
+Render functions, they only write the framebuffer
+
+*/
+static void renderRoom()
+{
+  writeCharToSegment(0, 'r');
+  writeNumberToSegment(1, currentRoom + 1);
+  writeCharToSegment(2, ' ');
+  writeCharToSegment(3, ' ');
+}
+
+static void renderCurrentTemp() { writeFixedPoint(roomCurrentTemp[currentRoom], 1, 'c'); }
+static void renderMenuMin() { writeString("min"); }
+static void renderMenuMax() { writeString("max"); }
+static void renderMenuBack() { writeString("back"); }
+static void renderEditMin() { writeFixedPoint(roomMinTemp[currentRoom], 1, 'c'); }
+static void renderEditMax() { writeFixedPoint(roomMaxTemp[currentRoom], 1, 'c'); }
+static void renderHistoryAge() { writeFixedPoint(-historyHour, 0, 'h'); }
+
+// Average of the four 15 minute buckets of the hour, dashes until there is one
+static void renderHistory()
+{
+  struct HistoryEntry entry;
+  int16_t sum = 0;
+  uint8_t count = 0;
+
+  for (uint8_t age = (historyHour - 1) * 4; age < historyHour * 4; age++)
+  {
+    if (!getHistory(currentRoom, HISTORY_TIER_QUARTERS, age, &entry))
+      break;
+
+    sum += entry.average;
+    count++;
+  }
+
+  if (count)
+    writeFixedPoint(sum / count, 1, 'c');
+  else
+    writeString("----");
+}
+
+static const struct Screen SCREENS[UI_STATE_COUNT] PROGMEM = {
+  [UI_ROOM] = {renderRoom, 0},
+  [UI_CURRENT_TEMP] = {renderCurrentTemp, UI_DATA_TEMPERATURE},
+  [UI_MENU_MIN] = {renderMenuMin, 0},
+  [UI_MENU_MAX] = {renderMenuMax, 0},
+  [UI_MENU_BACK] = {renderMenuBack, 0},
+  [UI_EDIT_MIN] = {renderEditMin, UI_DATA_SETPOINTS},
+  [UI_EDIT_MAX] = {renderEditMax, UI_DATA_SETPOINTS},
+  [UI_HISTORY] = {renderHistory, UI_DATA_HISTORY},
+  [UI_HISTORY_AGE] = {renderHistoryAge, 0},
+};
+
+static const struct Transition TRANSITIONS[UI_STATE_COUNT][UI_INPUT_COUNT] PROGMEM = {
+  // Room selector
+  [UI_ROOM] = {
+    [UI_LEFT] = {UI_ROOM, previousRoom},
+    [UI_CENTER] = {UI_MENU_MIN, 0},
+    [UI_RIGHT] = {UI_CURRENT_TEMP, nextRoom},
+  },
+  [UI_CURRENT_TEMP] = {
+    [UI_LEFT] = {UI_ROOM, 0},
+    [UI_CENTER] = {UI_MENU_MIN, 0},
+    [UI_RIGHT] = {UI_HISTORY, firstHistoryHour},
+  },
+  // Hourly history of the room, going right goes back in time, the center button
+  // switches between the temperature and how many hours ago it was
+  [UI_HISTORY] = {
+    [UI_LEFT] = {UI_CURRENT_TEMP, newerHour},
+    [UI_CENTER] = {UI_HISTORY_AGE, 0},
+    [UI_RIGHT] = {UI_HISTORY, olderHour},
+  },
+  [UI_HISTORY_AGE] = {
+    [UI_LEFT] = {UI_CURRENT_TEMP, newerHour},
+    [UI_CENTER] = {UI_HISTORY, 0},
+    [UI_RIGHT] = {UI_HISTORY_AGE, olderHour},
+  },
+  // Room details [ MIN, MAX, BACK ]
+  [UI_MENU_MIN] = {
+    [UI_CENTER] = {UI_EDIT_MIN, 0},
+    [UI_RIGHT] = {UI_MENU_MAX, 0},
+  },
+  [UI_MENU_MAX] = {
+    [UI_LEFT] = {UI_MENU_MIN, 0},
+    [UI_CENTER] = {UI_EDIT_MAX, 0},
+    [UI_RIGHT] = {UI_MENU_BACK, 0},
+  },
+  [UI_MENU_BACK] = {
+    [UI_LEFT] = {UI_MENU_MAX, 0},
+    [UI_CENTER] = {UI_ROOM, 0},
+  },
+  // Change min / max temperature, holding a button goes faster
+  [UI_EDIT_MIN] = {
+    [UI_LEFT] = {UI_EDIT_MIN, lowerSetpoint},
+    [UI_CENTER] = {UI_MENU_MIN, 0},
+    [UI_RIGHT] = {UI_EDIT_MIN, raiseSetpoint},
+    [UI_LEFT_HOLD] = {UI_EDIT_MIN, lowerSetpoint},
+    [UI_RIGHT_HOLD] = {UI_EDIT_MIN, raiseSetpoint},
+    [UI_LEFT_FAST] = {UI_EDIT_MIN, lowerSetpointFast},
+    [UI_RIGHT_FAST] = {UI_EDIT_MIN, raiseSetpointFast},
+  },
+  [UI_EDIT_MAX] = {
+    [UI_LEFT] = {UI_EDIT_MAX, lowerSetpoint},
+    [UI_CENTER] = {UI_MENU_MIN, 0},
+    [UI_RIGHT] = {UI_EDIT_MAX, raiseSetpoint},
+    [UI_LEFT_HOLD] = {UI_EDIT_MAX, lowerSetpoint},
+    [UI_RIGHT_HOLD] = {UI_EDIT_MAX, raiseSetpoint},
+    [UI_LEFT_FAST] = {UI_EDIT_MAX, lowerSetpointFast},
+    [UI_RIGHT_FAST] = {UI_EDIT_MAX, raiseSetpointFast},
+  },
+};
+
+static void render()
+{
+  struct Screen screen;
+  memcpy_P(&screen, &SCREENS[uiState], sizeof(screen));
+  screen.render();
+}
+
+// Maps a button event to an input of the transition table
+static uint8_t inputFromButton(uint8_t event)
+{
+  uint8_t button = BUTTON_EVENT_BUTTON(event);
+
+  switch (BUTTON_EVENT_TYPE(event))
+  {
+    case BUTTON_PRESS:
+      return button;
+    case BUTTON_REPEAT:
+      return button == 0 ? UI_LEFT_HOLD : UI_RIGHT_HOLD;
+    case BUTTON_REPEAT_FAST:
+      return button == 0 ? UI_LEFT_FAST : UI_RIGHT_FAST;
+  }
+  return UI_NO_INPUT;
+}
+
+void uiInit()
+{
+  uiState = UI_ROOM;
+  currentRoom = 0;
+  render();
+}
+
+void uiHandleButton(uint8_t buttonEvent)
+{
+  uint8_t input = inputFromButton(buttonEvent);
+  if (input == UI_NO_INPUT)
+    return;
+
+  struct Transition transition;
+  memcpy_P(&transition, &TRANSITIONS[uiState][input], sizeof(transition));
+  if (transition.next == UI_NONE)
+    return;
+
+  if (transition.action)
+    uiState = transition.action(transition.next);
+  else
+    uiState = transition.next;
+
+  render();
+}
+
+void uiNotify(uint8_t data)
+{
+  if (pgm_read_byte(&SCREENS[uiState].shows) & data)
+    render();
+}
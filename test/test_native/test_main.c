@@ -0,0 +1,386 @@
+/*
+
+Tests of the native HAL ( lib/hal ), run with: pio test -e native
+
+The registers are plain memory here, every test sets the inputs itself and
+runs the interrupt handlers with halRaiseInterrupt() like the hardware would.
+The libraries keep their state between tests, a test that needs a clean one
+starts the library over itself.
+
+*/
+#include <unity.h>
+
+#include <hal.h>
+
+#include <usart.h>
+#include <display.h>
+#include <buttons.h>
+#include <events.h>
+#include <scheduler.h>
+#include <sensor.h>
+#include <leds.h>
+#include <rooms.h>
+#include <control.h>
+#include <storage.h>
+#include <sram.h>
+
+// The tick hook of the firmware, src/ is built with the tests
+void sampleButtonsTick();
+
+void setUp()
+{
+  halNativeReset();
+}
+
+void tearDown()
+{
+}
+
+// Runs the transmit interrupt until it turns itself off, returns the bytes it sent
+static uint8_t drainUSART(uint8_t *sent, uint8_t size)
+{
+  uint8_t count = 0;
+
+  while (UCSR0B & _BV(UDRIE0))
+  {
+    halRaiseInterrupt(USART_UDRE_vect);
+    if ((UCSR0B & _BV(UDRIE0)) && count < size)
+      sent[count++] = UDR0;
+  }
+  return count;
+}
+
+void testUSARTRoundTrip()
+{
+  uint8_t sent[16];
+  uint8_t received;
+
+  initUSART();
+  sei();
+
+  TEST_ASSERT_EQUAL_UINT8(5, transmitBuffer((const uint8_t *)"hello", 5));
+  TEST_ASSERT_EQUAL_UINT8(5, drainUSART(sent, sizeof(sent)));
+  TEST_ASSERT_EQUAL_MEMORY("hello", sent, 5);
+  TEST_ASSERT_EQUAL_UINT8(USART_TX_BUFFER_SIZE - 1, getUSARTTxFree());
+
+  TEST_ASSERT_FALSE(tryReceive(&received));
+  UDR0 = 'x';
+  halRaiseInterrupt(USART_RX_vect);
+  TEST_ASSERT_TRUE(tryReceive(&received));
+  TEST_ASSERT_EQUAL_UINT8('x', received);
+}
+
+void testUSARTDropsWhatDoesNotFit()
+{
+  uint8_t sent[USART_TX_BUFFER_SIZE];
+
+  initUSART();
+  sei();
+
+  uint16_t overflows = getUSARTTxOverflows();
+  for (uint8_t i = 0; i < USART_TX_BUFFER_SIZE + 2; i++)
+    transmitByte(i);
+
+  TEST_ASSERT_EQUAL_UINT8(0, getUSARTTxFree());
+  TEST_ASSERT_EQUAL_UINT16(overflows + 3, getUSARTTxOverflows());
+  TEST_ASSERT_EQUAL_UINT8(USART_TX_BUFFER_SIZE - 1, drainUSART(sent, sizeof(sent)));
+  TEST_ASSERT_EQUAL_UINT8(USART_TX_BUFFER_SIZE - 2, sent[USART_TX_BUFFER_SIZE - 2]);
+}
+
+void testFormatFixedPoint()
+{
+  uint8_t segments[NUMBER_OF_DIGITS];
+
+  // 21.5c, the decimal point is bit 7 of the second digit, low because the segments are active low
+  formatFixedPoint(segments, 215, 1, 'c');
+  TEST_ASSERT_EQUAL_HEX8(getSegmentsFromChar('2'), segments[0]);
+  TEST_ASSERT_BIT_LOW(7, segments[1]);
+  TEST_ASSERT_EQUAL_HEX8(getSegmentsFromChar('1'), segments[1] | 0x80);
+  TEST_ASSERT_EQUAL_HEX8(getSegmentsFromChar('5'), segments[2]);
+  TEST_ASSERT_EQUAL_HEX8(getSegmentsFromChar('c'), segments[3]);
+
+  // -0.5c keeps the zero in front of the point
+  formatFixedPoint(segments, -5, 1, 'c');
+  TEST_ASSERT_EQUAL_HEX8(getSegmentsFromChar('-'), segments[0]);
+  TEST_ASSERT_EQUAL_HEX8(getSegmentsFromChar('5'), segments[2]);
+
+  // Too big for three digits
+  formatFixedPoint(segments, 10000, 1, 'c');
+  TEST_ASSERT_EQUAL_HEX8(getSegmentsFromChar('-'), segments[0]);
+  TEST_ASSERT_EQUAL_HEX8(getSegmentsFromChar('-'), segments[2]);
+}
+
+void testButtonPressThroughTimer0()
+{
+  struct Event event;
+
+  initScheduler();
+  setTickHook(sampleButtonsTick);
+  sei();
+
+  // Released, the buttons pull the pins low when pushed
+  PINC = 0xFF;
+  for (uint16_t i = 0; i < 100; i++)
+    halRaiseInterrupt(TIMER0_COMPA_vect);
+  TEST_ASSERT_FALSE(popEvent(&event));
+
+  // A bounce shorter than the debounce time is ignored
+  PINC &= ~_BV(PC1);
+  halRaiseInterrupt(TIMER0_COMPA_vect);
+  PINC |= _BV(PC1);
+  for (uint16_t i = 0; i < 100; i++)
+    halRaiseInterrupt(TIMER0_COMPA_vect);
+  TEST_ASSERT_FALSE(popEvent(&event));
+
+  // Pushed for 100 ms
+  PINC &= ~_BV(PC1);
+  for (uint16_t i = 0; i < 100; i++)
+    halRaiseInterrupt(TIMER0_COMPA_vect);
+
+  TEST_ASSERT_TRUE(popEvent(&event));
+  TEST_ASSERT_EQUAL_UINT8(EVENT_BUTTON, event.type);
+  TEST_ASSERT_EQUAL_UINT8(BUTTON_EVENT(BUTTON_PRESS, 0), event.data);
+  TEST_ASSERT_EQUAL_UINT32(301, millis());
+}
+
+// Answers the conversions of the running scan with value, returns how many there were
+static uint8_t convert(uint16_t value, uint8_t conversions)
+{
+  uint8_t count = 0;
+
+  for (; count < conversions && (ADCSRA & _BV(ADIE)); count++)
+  {
+    ADC = value;
+    halRaiseInterrupt(ADC_vect);
+  }
+  return count;
+}
+
+void testADCScanAndConversion()
+{
+  struct Event event;
+
+  while (popEvent(&event))
+    ;
+
+  initADC();
+  sei();
+  TEST_ASSERT_TRUE(startADCScan(_BV(4) | _BV(5)));
+  TEST_ASSERT_TRUE(adcSampling());
+  TEST_ASSERT_EQUAL_UINT8(4, ADMUX & 0x0F);
+
+  // The conversion right after the switch is thrown away
+  TEST_ASSERT_EQUAL_UINT8(ADC_SETTLE_SAMPLES, convert(1023, ADC_SETTLE_SAMPLES));
+  TEST_ASSERT_EQUAL_UINT8(ADC_SAMPLES, convert(51, ADC_SAMPLES));
+  TEST_ASSERT_EQUAL_UINT8(5, ADMUX & 0x0F);
+  TEST_ASSERT_FALSE(popEvent(&event));
+
+  TEST_ASSERT_EQUAL_UINT8(ADC_SETTLE_SAMPLES + ADC_SAMPLES, convert(52, 0xFF));
+  TEST_ASSERT_FALSE(adcSampling());
+
+  TEST_ASSERT_TRUE(popEvent(&event));
+  TEST_ASSERT_EQUAL_UINT8(EVENT_SENSOR_READY, event.type);
+  TEST_ASSERT_EQUAL_HEX8(_BV(4) | _BV(5), event.data);
+
+  // The default gain is 4.22 tenths of a degree per step: 51 steps are 21.5 degrees, 52 are 21.9
+  TEST_ASSERT_EQUAL_UINT16(51 << ADC_OVERSAMPLE_BITS, getADCResult(4));
+  updateTemperatures(event.data);
+  TEST_ASSERT_EQUAL_INT16(215, getChannelTemperature(4));
+  TEST_ASSERT_EQUAL_INT16(219, getChannelTemperature(5));
+
+  // A calibrated channel, the filter moves a quarter of the way per scan
+  setChannelCalibration(4, SENSOR_GAIN_Q8, -15);
+  updateTemperatures(_BV(4));
+  TEST_ASSERT_EQUAL_INT16(211, getChannelTemperature(4));
+}
+
+void testOutputsOnlyChangeOnCommit()
+{
+  // PB0 and PB1 belong to the display and must not change
+  PORTB = _BV(PB0);
+  initOutputs();
+  TEST_ASSERT_EQUAL_HEX8(_BV(PB0) | _BV(PB2) | _BV(PB3) | _BV(PB4) | _BV(PB5), PORTB);
+
+  setOutput(0, 1);
+  setOutput(2, 1);
+  TEST_ASSERT_EQUAL_HEX8(0x05, getOutputs());
+  TEST_ASSERT_EQUAL_HEX8(_BV(PB0) | _BV(PB2) | _BV(PB3) | _BV(PB4) | _BV(PB5), PORTB);
+
+  // The LEDs are active low
+  commitOutputs();
+  TEST_ASSERT_EQUAL_HEX8(_BV(PB0) | _BV(PB3) | _BV(PB5), PORTB);
+
+  // Nothing staged changed, so nothing is written
+  PORTB |= _BV(PB1);
+  commitOutputs();
+  TEST_ASSERT_EQUAL_HEX8(_BV(PB0) | _BV(PB1) | _BV(PB3) | _BV(PB5), PORTB);
+
+  setOutputs(0);
+  commitOutputs();
+  TEST_ASSERT_EQUAL_HEX8(_BV(PB0) | _BV(PB1) | _BV(PB2) | _BV(PB3) | _BV(PB4) | _BV(PB5), PORTB);
+}
+
+// One room from 20.0 to 25.0 degrees, a sample on every tick
+static void startControl(uint8_t mode, temperature_t temperature)
+{
+  roomCount = 0;
+  addRoom(200, 250);
+  roomCurrentTemp[0] = temperature;
+
+  initControl();
+  setControlMode(0, mode);
+  setControlTiming(0, 1, 0, 0);
+}
+
+static uint8_t heating()
+{
+  return (roomState[0] & ROOM_HEATING) != 0;
+}
+
+void testOnOffHysteresis()
+{
+  startControl(CONTROL_ONOFF, 199);
+  controlTick();
+  TEST_ASSERT_TRUE(heating());
+
+  // Inside the band nothing changes, in either direction
+  roomCurrentTemp[0] = 200 + CONTROL_HYSTERESIS - 1;
+  controlTick();
+  TEST_ASSERT_TRUE(heating());
+
+  roomCurrentTemp[0] = 200 + CONTROL_HYSTERESIS;
+  controlTick();
+  TEST_ASSERT_FALSE(heating());
+
+  roomCurrentTemp[0] = 200;
+  controlTick();
+  TEST_ASSERT_FALSE(heating());
+
+  // Stays on for at least minOnSeconds ticks
+  setControlTiming(0, 1, 3, 0);
+  roomCurrentTemp[0] = 199;
+  controlTick();
+  TEST_ASSERT_TRUE(heating());
+
+  roomCurrentTemp[0] = 210;
+  controlTick();
+  controlTick();
+  TEST_ASSERT_TRUE(heating());
+  controlTick();
+  TEST_ASSERT_FALSE(heating());
+}
+
+void testPidIntegratesAndDoesNotWindUp()
+{
+  // One tenth below the target: 50 permille from kp, 1 more per sample from ki
+  startControl(CONTROL_PID, 200 + CONTROL_HYSTERESIS - 1);
+  for (uint8_t i = 0; i < 10; i++)
+    controlTick();
+  TEST_ASSERT_EQUAL_UINT16(60, getControlDuty(0));
+
+  // Saturated far below the target, the integral must not keep growing
+  startControl(CONTROL_PID, 150);
+  for (uint8_t i = 0; i < 100; i++)
+    controlTick();
+  TEST_ASSERT_EQUAL_UINT16(CONTROL_DUTY_MAX, getControlDuty(0));
+
+  // So at the target the output drops at once instead of staying on
+  roomCurrentTemp[0] = 200 + CONTROL_HYSTERESIS;
+  controlTick();
+  TEST_ASSERT_EQUAL_UINT16(0, getControlDuty(0));
+}
+
+// Runs the scheduler and the EEPROM for ms milliseconds, one byte write takes a few of them
+static void runStorage(uint16_t ms)
+{
+  for (uint16_t i = 0; i < ms; i++)
+  {
+    runTasks();
+    halRaiseInterrupt(TIMER0_COMPA_vect);
+    halEepromCycle();
+    if (EECR & _BV(EERIE))
+      halRaiseInterrupt(EE_READY_vect);
+  }
+}
+
+void testSettingsRoundTripThroughEeprom()
+{
+  initScheduler();
+  setTickHook(0);
+  sei();
+
+  roomCount = 0;
+  initControl();
+  addRoom(180, 210);
+  addRoom(160, 240);
+  roomSensorChannel[1] = 5;
+  setControlMode(1, CONTROL_PID);
+  setControlGains(1, 384, 128, 0);
+  setControlTiming(0, 5, 120, 300);
+
+  uint16_t writes = getStorageWrites();
+  settingsChanged();
+  runStorage(STORAGE_SAVE_DELAY_MS - 1);
+  TEST_ASSERT_EQUAL_UINT16(writes, getStorageWrites());
+  runStorage(500);
+  TEST_ASSERT_EQUAL_UINT16(writes + 1, getStorageWrites());
+  TEST_ASSERT_EQUAL_UINT8(STORAGE_VERSION, halEeprom[STORAGE_START]);
+
+  roomCount = 0;
+  initControl();
+  TEST_ASSERT_TRUE(loadSettings());
+  TEST_ASSERT_EQUAL_UINT8(2, roomCount);
+  TEST_ASSERT_EQUAL_INT16(160, roomMinTemp[1]);
+  TEST_ASSERT_EQUAL_INT16(240, roomMaxTemp[1]);
+  TEST_ASSERT_EQUAL_UINT8(5, roomSensorChannel[1]);
+  TEST_ASSERT_EQUAL_UINT8(CONTROL_ONOFF, getControlMode(0));
+  TEST_ASSERT_EQUAL_UINT8(CONTROL_PID, getControlMode(1));
+
+  int16_t kp, ki, kd;
+  getControlGains(1, &kp, &ki, &kd);
+  TEST_ASSERT_EQUAL_INT16(384, kp);
+  TEST_ASSERT_EQUAL_INT16(128, ki);
+
+  uint8_t sampleTicks;
+  uint16_t minOn, minOff;
+  getControlTiming(0, &sampleTicks, &minOn, &minOff);
+  TEST_ASSERT_EQUAL_UINT8(5, sampleTicks);
+  TEST_ASSERT_EQUAL_UINT16(120, minOn);
+  TEST_ASSERT_EQUAL_UINT16(300, minOff);
+}
+
+void testStackHighWaterMarkInHalRam()
+{
+  struct SramStats stats;
+
+  setTickHook(0);
+  sei();
+  paintStack();
+
+  // The deepest the stack went, then where it is now
+  memset(&halRam[RAMEND - 99], 0, 100);
+  SP = RAMEND - 20;
+  halRaiseInterrupt(TIMER0_COMPA_vect);
+
+  getSramStats(&stats);
+  TEST_ASSERT_EQUAL_UINT16(20, stats.stack);
+  TEST_ASSERT_EQUAL_UINT16(100, stats.stackMax);
+  TEST_ASSERT_EQUAL_UINT16(stats.stackMax + stats.unused + stats.heap + stats.data, RAMEND + 1 - RAMSTART);
+  TEST_ASSERT_TRUE(getIsrStack(SRAM_ISR_TIMER0) >= 20);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(testUSARTRoundTrip);
+  RUN_TEST(testUSARTDropsWhatDoesNotFit);
+  RUN_TEST(testFormatFixedPoint);
+  RUN_TEST(testButtonPressThroughTimer0);
+  RUN_TEST(testADCScanAndConversion);
+  RUN_TEST(testOutputsOnlyChangeOnCommit);
+  RUN_TEST(testOnOffHysteresis);
+  RUN_TEST(testPidIntegratesAndDoesNotWindUp);
+  RUN_TEST(testSettingsRoundTripThroughEeprom);
+  RUN_TEST(testStackHighWaterMarkInHalRam);
+  return UNITY_END();
+}
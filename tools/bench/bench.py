@@ -0,0 +1,69 @@
+# PlatformIO extra script of the bench env, adds the "bench" target:
+#
+#   pio run -e bench -t bench
+#
+# It builds tools/bench/simbench, runs the bench firmware under simavr and
+# writes the cycle counts of every marker in lib/bench/bench.h together with
+# the section sizes of the image to .pio/build/bench/bench.json.
+# Compare two of those files with tools/bench/compare.py.
+
+import json
+import os
+import re
+import subprocess
+
+Import("env")
+
+BENCH_DIR = os.path.join(env.subst("$PROJECT_DIR"), "tools", "bench")
+BENCH_HEADER = os.path.join(env.subst("$PROJECT_DIR"), "lib", "bench", "bench.h")
+
+
+def marker_names():
+    names = {}
+    with open(BENCH_HEADER) as header:
+        for line in header:
+            match = re.match(r"#define BENCH_(\w+) (\d+)\s*$", line)
+            if match:
+                names[match.group(2)] = match.group(1).lower()
+    return names
+
+
+def section_sizes(elf):
+    output = subprocess.check_output([env.subst("$SIZETOOL"), "-A", elf], text=True)
+    sizes = {}
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[0].startswith(".") and fields[1].isdigit():
+            sizes[fields[0]] = int(fields[1])
+    return sizes
+
+
+def run_bench(target, source, env):
+    elf = env.subst("$BUILD_DIR/${PROGNAME}.elf")
+    result = env.subst("$BUILD_DIR/bench.json")
+
+    subprocess.check_call(["make", "-s", "-C", BENCH_DIR])
+    output = subprocess.check_output([os.path.join(BENCH_DIR, "simbench"), elf], text=True)
+
+    names = marker_names()
+    cycles = {names.get(id, id): stats for id, stats in json.loads(output).items()}
+    report = {"cycles": cycles, "sections": section_sizes(elf)}
+
+    with open(result, "w") as out:
+        json.dump(report, out, indent=2, sort_keys=True)
+
+    for name, stats in sorted(cycles.items()):
+        print("%-20s %6d runs  min %7d  avg %7d  max %7d cycles"
+              % (name, stats["count"], stats["min"], stats["avg"], stats["max"]))
+    for name, size in sorted(report["sections"].items()):
+        print("%-20s %6d bytes" % (name, size))
+    print("Results written to %s" % result)
+
+
+env.AddCustomTarget(
+    name="bench",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions=[run_bench],
+    title="Bench",
+    description="Run the firmware under simavr and report cycle counts and section sizes",
+)
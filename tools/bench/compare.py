@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""Compares two bench.json files written by the bench target.
+
+usage: compare.py old.json new.json [--threshold PERCENT]
+
+Prints the change of every average and max cycle count and every section
+size. Exits with 1 when something grew by more than the threshold
+(5 % by default), so it can guard a commit.
+"""
+
+import argparse
+import json
+import sys
+
+
+def change(old, new):
+    if old == 0:
+        return 0.0 if new == 0 else float("inf")
+    return (new - old) * 100.0 / old
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=5.0)
+    args = parser.parse_args()
+
+    with open(args.old) as f:
+        old = json.load(f)
+    with open(args.new) as f:
+        new = json.load(f)
+
+    rows = []
+    for name in sorted(set(old["cycles"]) | set(new["cycles"])):
+        for field in ("avg", "max"):
+            before = old["cycles"].get(name, {}).get(field)
+            after = new["cycles"].get(name, {}).get(field)
+            rows.append(("%s.%s" % (name, field), before, after))
+    for name in sorted(set(old["sections"]) | set(new["sections"])):
+        rows.append((name, old["sections"].get(name), new["sections"].get(name)))
+
+    regressions = 0
+    for name, before, after in rows:
+        if before is None or after is None:
+            print("%-28s %10s -> %10s" % (name, before, after))
+            continue
+        percent = change(before, after)
+        flag = ""
+        if percent > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        print("%-28s %10d -> %10d  %+7.1f%%%s" % (name, before, after, percent, flag))
+
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,131 @@
+/* Runs the bench firmware under simavr and prints the cycles spent between
+   the BENCH_BEGIN / BENCH_END markers of lib/bench/bench.h as json.
+
+   usage: simbench firmware.elf
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/sim_time.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_adc.h>
+
+#define F_CPU 16000000UL
+
+/* Data space addresses of GPIOR1 and GPIOR2 */
+#define BENCH_BEGIN_ADDRESS 0x4A
+#define BENCH_END_ADDRESS 0x4B
+
+#define BENCH_DONE 0xFF
+
+/* Stop after this many simulated seconds even if the firmware never finishes */
+#define TIMEOUT_SECONDS 10
+
+/* Millivolts on the sensor input, roughly room temperature */
+#define SENSOR_MILLIVOLTS 250
+
+/* The right button (PC3) is pressed and released every BUTTON_PERIOD_MS */
+#define BUTTON_PORT 'C'
+#define BUTTON_PIN 3
+#define BUTTON_PERIOD_MS 200
+
+struct region
+{
+    uint32_t count;
+    avr_cycle_count_t begin;
+    avr_cycle_count_t min;
+    avr_cycle_count_t max;
+    avr_cycle_count_t total;
+};
+
+static struct region regions[256];
+static int done = 0;
+
+static void onBegin(struct avr_t *avr, avr_io_addr_t addr, uint8_t id, void *param)
+{
+    if (id == BENCH_DONE) {
+        done = 1;
+        return;
+    }
+    regions[id].begin = avr->cycle;
+}
+
+static void onEnd(struct avr_t *avr, avr_io_addr_t addr, uint8_t id, void *param)
+{
+    struct region *region = &regions[id];
+    avr_cycle_count_t cycles = avr->cycle - region->begin;
+
+    if (region->count == 0 || cycles < region->min) region->min = cycles;
+    if (cycles > region->max) region->max = cycles;
+    region->total += cycles;
+    region->count++;
+}
+
+static avr_cycle_count_t toggleButton(struct avr_t *avr, avr_cycle_count_t when, void *param)
+{
+    static uint32_t level = 1;
+    level = !level;
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(BUTTON_PORT), BUTTON_PIN), level);
+    return when + avr_usec_to_cycles(avr, BUTTON_PERIOD_MS * 1000UL / 2);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s firmware.elf\n", argv[0]);
+        return 2;
+    }
+
+    elf_firmware_t firmware = {0};
+    if (elf_read_firmware(argv[1], &firmware) != 0) {
+        fprintf(stderr, "simbench: cannot read %s\n", argv[1]);
+        return 1;
+    }
+
+    avr_t *avr = avr_make_mcu_by_name("atmega328p");
+    if (!avr) {
+        fprintf(stderr, "simbench: simavr has no atmega328p core\n");
+        return 1;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+    avr->frequency = F_CPU;
+    avr->vcc = avr->avcc = avr->aref = 5000; /* millivolts, the ADC uses AVcc */
+
+    avr_register_io_write(avr, BENCH_BEGIN_ADDRESS, onBegin, NULL);
+    avr_register_io_write(avr, BENCH_END_ADDRESS, onEnd, NULL);
+
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC4), SENSOR_MILLIVOLTS);
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(BUTTON_PORT), BUTTON_PIN), 1);
+    avr_cycle_timer_register_usec(avr, BUTTON_PERIOD_MS * 1000UL, toggleButton, NULL);
+
+    avr_cycle_count_t timeout = TIMEOUT_SECONDS * F_CPU;
+    int state = cpu_Running;
+    while (!done && avr->cycle < timeout && state != cpu_Done && state != cpu_Crashed) {
+        state = avr_run(avr);
+    }
+
+    if (!done) {
+        fprintf(stderr, "simbench: firmware did not finish (state %d, cycle %llu)\n",
+                state, (unsigned long long) avr->cycle);
+        return 1;
+    }
+
+    printf("{\n");
+    int first = 1;
+    for (int id = 0; id < 256; id++) {
+        struct region *region = &regions[id];
+        if (region->count == 0) continue;
+        printf("%s  \"%d\": {\"count\": %u, \"min\": %llu, \"max\": %llu, \"avg\": %llu}",
+               first ? "" : ",\n", id, region->count,
+               (unsigned long long) region->min, (unsigned long long) region->max,
+               (unsigned long long) (region->total / region->count));
+        first = 0;
+    }
+    printf("\n}\n");
+    return 0;
+}
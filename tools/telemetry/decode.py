@@ -0,0 +1,262 @@
+#!/usr/bin/env python3
+"""Decodes the binary telemetry of the thermostat (lib/telemetry).
+
+usage: decode.py PORT [--baud 9600]
+       decode.py --selftest
+
+Reads the serial port and prints every sample as one JSON line. Text the
+firmware prints between the frames, like the boot messages, is passed
+through as {"text": ...}. Frames with a bad CRC and lost frames are counted
+and reported on stderr.
+
+--selftest encodes frames here, writes them together with text and a
+corrupted frame to a pseudo-terminal and checks what the decoder reads back
+from the other side, the same way it reads a real port.
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+import termios
+import threading
+import tty
+
+FRAME_SAMPLES = 1
+HEADER = struct.Struct("<BBBBH")
+
+
+def crc_ccitt(data, crc=0xFFFF):
+    """CRC-16/CCITT as computed by _crc_ccitt_update() of avr-libc."""
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_index = 0
+    for byte in data:
+        if byte:
+            out.append(byte)
+        if not byte or len(out) - code_index == 0xFF:
+            out[code_index] = len(out) - code_index
+            code_index = len(out)
+            out.append(0)
+    out[code_index] = len(out) - code_index
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            raise ValueError("bad COBS block")
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def encode_frame(sequence, period, setpoints, samples):
+    """Builds a frame like the firmware does, setpoints is a list of
+    (min, max) per room, samples a list of (heating bits, [temperatures])."""
+    payload = bytearray(HEADER.pack(FRAME_SAMPLES, sequence & 0xFF, len(setpoints),
+                                    len(samples), period))
+    for low, high in setpoints:
+        payload += struct.pack("<hh", low, high)
+    for heating, temperatures in samples:
+        payload += struct.pack("<B%dh" % len(temperatures), heating, *temperatures)
+    payload += struct.pack("<H", crc_ccitt(payload))
+    return b"\x00" + cobs_encode(payload) + b"\x00"
+
+
+def parse_frame(payload):
+    """Returns the samples of a decoded frame as dicts, raises ValueError."""
+    if len(payload) < HEADER.size + 2:
+        raise ValueError("frame too short")
+    if crc_ccitt(payload[:-2]) != struct.unpack_from("<H", payload, len(payload) - 2)[0]:
+        raise ValueError("bad CRC")
+
+    kind, sequence, rooms, count, period = HEADER.unpack_from(payload)
+    if kind != FRAME_SAMPLES:
+        raise ValueError("unknown frame type %d" % kind)
+    if len(payload) != HEADER.size + rooms * 4 + count * (1 + 2 * rooms) + 2:
+        raise ValueError("frame length does not match its header")
+
+    offset = HEADER.size
+    setpoints = []
+    for _ in range(rooms):
+        setpoints.append(struct.unpack_from("<hh", payload, offset))
+        offset += 4
+
+    samples = []
+    for index in range(count):
+        heating = payload[offset]
+        temperatures = struct.unpack_from("<%dh" % rooms, payload, offset + 1)
+        offset += 1 + 2 * rooms
+        samples.append({
+            "sequence": sequence,
+            "sample": index,
+            "period_ms": period,
+            "rooms": [{
+                "temperature": temperatures[room] / 10.0,
+                "min": setpoints[room][0] / 10.0,
+                "max": setpoints[room][1] / 10.0,
+                "heating": bool(heating & (1 << room)),
+            } for room in range(rooms)],
+        })
+    return sequence, samples
+
+
+class Decoder:
+    """Feed it bytes, it returns the samples and text of every complete frame."""
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.last_sequence = None
+        self.bad_frames = 0
+        self.lost_frames = 0
+
+    def feed(self, data):
+        records = []
+        self.buffer += data
+        while True:
+            end = self.buffer.find(b"\x00")
+            if end < 0:
+                return records
+            chunk = bytes(self.buffer[:end])
+            del self.buffer[:end + 1]
+            if chunk:
+                records += self.chunk(chunk)
+
+    def chunk(self, chunk):
+        try:
+            sequence, samples = parse_frame(cobs_decode(chunk))
+        except ValueError:
+            lines = chunk.decode("ascii", "replace").splitlines()
+            if lines and all(line.isprintable() for line in lines):
+                return [{"text": line} for line in lines if line]
+            self.bad_frames += 1
+            return []
+
+        if self.last_sequence is not None:
+            self.lost_frames += (sequence - self.last_sequence - 1) & 0xFF
+        self.last_sequence = sequence
+        return samples
+
+
+def open_port(path, baud):
+    fd = os.open(path, os.O_RDONLY | os.O_NOCTTY)
+    if os.isatty(fd):
+        tty.setraw(fd)
+        attributes = termios.tcgetattr(fd)
+        speed = getattr(termios, "B%d" % baud)
+        attributes[4] = attributes[5] = speed
+        termios.tcsetattr(fd, termios.TCSANOW, attributes)
+    return fd
+
+
+def run(path, baud):
+    fd = open_port(path, baud)
+    decoder = Decoder()
+    try:
+        while True:
+            data = os.read(fd, 256)
+            if not data:
+                break
+            for record in decoder.feed(data):
+                print(json.dumps(record), flush=True)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        os.close(fd)
+        print("bad frames: %d, lost frames: %d" % (decoder.bad_frames, decoder.lost_frames),
+              file=sys.stderr)
+    return 0
+
+
+def selftest():
+    setpoints = [(180, 210), (160, 240)]
+    frames = [
+        encode_frame(0, 1000, setpoints, [(0b01, [175, 230]), (0b01, [176, -5])]),
+        encode_frame(1, 1000, setpoints, [(0b00, [181, 229])]),
+        # frame 2 gets lost on the way
+        encode_frame(3, 500, setpoints, [(0b10, [0, 400])] * 8),
+    ]
+    corrupted = bytearray(encode_frame(4, 1000, setpoints, [(0, [1, 2])]))
+    corrupted[5] ^= 0x10
+    stream = (b"Starting thermostat, please wait patient ...\n" + frames[0] +
+              b"\x00\x00" + frames[1] + bytes(corrupted) + frames[2])
+
+    master, slave = os.openpty()
+    fd = open_port(os.ttyname(slave), 9600)
+
+    # Write from a thread like a serial port would, in small pieces
+    def write():
+        for i in range(0, len(stream), 7):
+            os.write(master, stream[i:i + 7])
+
+    writer = threading.Thread(target=write)
+    writer.start()
+
+    decoder = Decoder()
+    records = []
+    received = 0
+    while received < len(stream):
+        data = os.read(fd, 256)
+        received += len(data)
+        records += decoder.feed(data)
+    writer.join()
+    os.close(fd)
+    os.close(slave)
+    os.close(master)
+
+    samples = [record for record in records if "sample" in record]
+    texts = [record["text"] for record in records if "text" in record]
+    checks = [
+        ("text passes through", texts == ["Starting thermostat, please wait patient ..."]),
+        ("every sample decoded", len(samples) == 11),
+        ("temperatures", samples[1]["rooms"][1]["temperature"] == -0.5 and
+         samples[10]["rooms"][1]["temperature"] == 40.0),
+        ("setpoints", samples[0]["rooms"][1]["min"] == 16.0 and
+         samples[0]["rooms"][0]["max"] == 21.0),
+        ("heating bits", samples[0]["rooms"][0]["heating"] and
+         not samples[0]["rooms"][1]["heating"] and samples[3]["rooms"][1]["heating"]),
+        ("period", samples[3]["period_ms"] == 500),
+        ("bad frame counted", decoder.bad_frames == 1),
+        ("lost frame counted", decoder.lost_frames == 1),
+        ("COBS round trip", all(cobs_decode(cobs_encode(data)) == data
+                                for data in (b"", b"\x00", b"\x01" * 254, b"\x01" * 255,
+                                             bytes(range(256)) * 2))),
+    ]
+
+    failed = 0
+    for name, ok in checks:
+        print("%-24s %s" % (name, "ok" if ok else "FAILED"))
+        failed += not ok
+    return 1 if failed else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port", nargs="?")
+    parser.add_argument("--baud", type=int, default=9600)
+    parser.add_argument("--selftest", action="store_true")
+    args = parser.parse_args()
+
+    if args.selftest:
+        return selftest()
+    if not args.port:
+        parser.error("the serial port is missing")
+    return run(args.port, args.baud)
+
+
+if __name__ == "__main__":
+    sys.exit(main())